@@ -0,0 +1,92 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Timing and synthetic readout data shared by the micro benchmarks
+ *
+ */
+
+#ifndef JADAQ_BENCH_HPP
+#define JADAQ_BENCH_HPP
+
+#include "caen.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bench {
+/* Seconds taken by f() */
+template <typename F> double time(F f) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void report(const char *name, double count, double seconds, const char *unit) {
+  printf("%-24s %10.3f s %10.1f M%s/s\n", name, seconds, count / seconds / 1e6, unit);
+}
+
+/* DPP-QDC data block of board aggregates, each with a group aggregate of
+ * list mode events for every group in groupMask. With extras the events
+ * are 3 words and carry a baseline and extended time. */
+class DPPQDCBlock {
+private:
+  std::vector<uint32_t> words;
+  caen::ReadoutBuffer buffer_;
+
+public:
+  DPPQDCBlock(unsigned boards, uint8_t groupMask, unsigned events, bool extras) {
+    uint32_t time = 0;
+    uint32_t seed = 5;
+    unsigned eventSize = extras ? 3 : 2;
+    for (unsigned b = 0; b < boards; ++b) {
+      size_t start = words.size();
+      words.push_back(0);
+      words.push_back(groupMask);
+      words.push_back(0);
+      words.push_back(0);
+      for (unsigned g = 0; g < 8; ++g) {
+        if (!(groupMask & (1u << g))) {
+          continue;
+        }
+        words.push_back(0x80000000u | (2 + events * eventSize));
+        words.push_back(0x60000000u | (extras ? 1u << 28 : 0));
+        for (unsigned e = 0; e < events; ++e) {
+          seed = seed * 1103515245u + 12345u;
+          words.push_back(time += 10);
+          if (extras) {
+            words.push_back(seed);
+          }
+          words.push_back(((e & 7u) << 28) | ((seed >> 8) & 0xffffu));
+        }
+      }
+      words[start] = 0xa0000000u | (uint32_t)(words.size() - start);
+    }
+    buffer_.data = reinterpret_cast<char *>(words.data());
+    buffer_.size = buffer_.dataSize = (uint32_t)(words.size() * sizeof(uint32_t));
+  }
+  DPPQDCBlock(const DPPQDCBlock &) = delete;
+  DPPQDCBlock &operator=(const DPPQDCBlock &) = delete;
+
+  const caen::ReadoutBuffer &buffer() const { return buffer_; }
+};
+} // namespace bench
+#endif // JADAQ_BENCH_HPP
@@ -0,0 +1,103 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Events per second decoding DPP-QDC list mode data: through the virtual
+ * calls of DataBlockBaseIterator, as before the decode loop was instantiated
+ * per iterator, through the concrete DPPQDCEventIterator, and through the
+ * whole DataHandler into DataWriterNull.
+ *
+ */
+
+#include "DataHandler.hpp"
+#include "DataWriter.hpp"
+#include "EventIterator.hpp"
+#include "bench.hpp"
+#include "container.hpp"
+#include <cstdlib>
+
+typedef Data::ListElement422 Element;
+
+/* The per-event calls of the old loop. The iterators are final now, so the
+ * compiler would otherwise guess the type and call them directly. */
+__attribute__((noinline, optimize("no-devirtualize", "no-devirtualize-speculatively")))
+static size_t decodeVirtual(DataBlockBaseIterator &it, jadaq::buffer<Element> &out) {
+  size_t events = 0;
+  for (; it != it.end(); ++it) {
+    if (out.full()) {
+      out.clear();
+    }
+    out.emplace_back(it.event<Element::EventType>(), it.group());
+    events += 1;
+  }
+  return events;
+}
+
+template <typename I>
+__attribute__((noinline)) static size_t decodeStatic(I &it, jadaq::buffer<Element> &out) {
+  size_t events = 0;
+  for (; it != it.end(); ++it) {
+    if (out.full()) {
+      out.clear();
+    }
+    out.emplace_back(it.template event<Element::EventType>(), it.group());
+    events += 1;
+  }
+  return events;
+}
+
+int main(int argc, char **argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 400;
+  // 64 board aggregates of 8 groups with 256 events each
+  bench::DPPQDCBlock block(64, 0xff, 256, false);
+  jadaq::buffer<Element> out(Data::maxBufferSize);
+  size_t events = 0;
+  double seconds = bench::time([&]() {
+    for (int r = 0; r < reps; ++r) {
+      DPPQDCEventIterator it(block.buffer());
+      events += decodeVirtual(it, out);
+    }
+  });
+  bench::report("virtual iterator", events, seconds, "events");
+
+  events = 0;
+  seconds = bench::time([&]() {
+    for (int r = 0; r < reps; ++r) {
+      DPPQDCEventIterator it(block.buffer());
+      events += decodeStatic(it, out);
+    }
+  });
+  bench::report("concrete iterator", events, seconds, "events");
+
+  DataWriter writer;
+  writer = new DataWriterNull();
+  uint32_t jitter[8] = {0};
+  DataHandler handler;
+  handler.initialize<Element>(writer, 1, 8, 0, jitter);
+  events = 0;
+  seconds = bench::time([&]() {
+    for (int r = 0; r < reps; ++r) {
+      DPPQDCEventIterator it(block.buffer());
+      events += handler(it);
+    }
+  });
+  bench::report("DataHandler", events, seconds, "events");
+  return 0;
+}
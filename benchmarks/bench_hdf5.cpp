@@ -0,0 +1,115 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Events per second written with each HDF5 layout, the size of the file, and
+ * how fast one digitizer is read back. Four digitizers deliver a buffer of
+ * 1000 DPP-QDC list mode events for each of a series of global time stamps,
+ * one time stamp per millisecond of a run.
+ *
+ */
+
+#include "DataWriterHDF5.hpp"
+#include "bench.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+typedef Data::ListElement422 Element;
+
+/* Reads every dataset of a digitizer group but the index */
+static herr_t readDataset(hid_t group, const char *name, const H5L_info_t *, void *bytes) {
+  if (std::string(name) == "index") {
+    return 0;
+  }
+  hid_t dataset = H5Dopen2(group, name, H5P_DEFAULT);
+  hid_t space = H5Dget_space(dataset);
+  hid_t type = H5Dget_type(dataset);
+  size_t size = H5Sget_simple_extent_npoints(space) * H5Tget_size(type);
+  std::vector<char> data(size);
+  H5Dread(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+  *static_cast<size_t *>(bytes) += size;
+  H5Tclose(type);
+  H5Sclose(space);
+  H5Dclose(dataset);
+  return 0;
+}
+
+static void run(const std::string &path, const char *name, int stamps) {
+  const int events = 1000;
+  const uint32_t digitizers = 4;
+  DataWriterHDF5::Options options;
+  options.layout = DataWriterHDF5::layout(name);
+  std::string basename = std::string("bench_hdf5-") + name;
+  std::string filename = path + basename + ".h5";
+  jadaq::buffer_pool<Element> pool(sizeof(Data::Header) + events * Element::size(), Element::size(),
+                                   sizeof(Data::Header));
+  double seconds = bench::time([&]() {
+    DataWriterHDF5 writer(path, basename, "", options);
+    for (uint32_t d = 1; d <= digitizers; ++d) {
+      writer.addDigitizer(d, Element::type(), 0);
+    }
+    uint32_t time = 0;
+    for (int s = 0; s < stamps; ++s) {
+      for (uint32_t d = 1; d <= digitizers; ++d) {
+        jadaq::buffer<Element> *buffer = pool.acquire();
+        if (buffer == nullptr) {
+          buffer = pool.allocate();
+        }
+        for (int i = 0; i < events; ++i) {
+          Element e;
+          e.time = time += 16;
+          e.channel = i & 15;
+          e.charge = (i * 37) & 4095;
+          buffer->push_back(e);
+        }
+        writer(buffer, d, 1500000000000ull + s);
+        buffer->release();
+      }
+    }
+  });
+  char label[32];
+  snprintf(label, sizeof(label), "write %s", name);
+  bench::report(label, (double)stamps * events * digitizers, seconds, "events");
+
+  struct stat st;
+  stat(filename.c_str(), &st);
+  size_t bytes = 0;
+  seconds = bench::time([&]() {
+    hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t group = H5Gopen2(file, "1", H5P_DEFAULT);
+    H5Literate(group, H5_INDEX_NAME, H5_ITER_NATIVE, nullptr, &readDataset, &bytes);
+    H5Gclose(group);
+    H5Fclose(file);
+  });
+  snprintf(label, sizeof(label), "read %s", name);
+  bench::report(label, (double)stamps * events, seconds, "events");
+  printf("%-24s %10.1f MB file, %.1f MB read\n", "", st.st_size / 1e6, bytes / 1e6);
+  remove(filename.c_str());
+}
+
+int main(int argc, char **argv) {
+  std::string path = argc > 1 ? std::string(argv[1]) + "/" : "./";
+  int stamps = argc > 2 ? atoi(argv[2]) : 2000;
+  run(path, "tables", stamps);
+  run(path, "appended", stamps);
+  run(path, "columns", stamps);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Hits per second through the time ordered merge of 64 streams delivered in
+ * readouts of 140 hits: in order within each stream, with one hit in 100
+ * moved back within the reorder window, and with every hit moved back.
+ *
+ */
+
+#include "bench.hpp"
+#include "merge.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <random>
+
+struct Hit {
+  uint64_t time;
+};
+
+/* Hits in the order they are pushed: rounds of one readout of 140 hits from
+ * every stream, in random order, each hit up to 400 later than the one
+ * before. Every shuffle-th hit is moved back by up to the window. */
+static std::vector<std::pair<size_t, Hit>> input(size_t streams, size_t hits, unsigned shuffle,
+                                                 uint64_t window) {
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> time(streams, 0);
+  std::vector<size_t> order(streams);
+  for (size_t s = 0; s < streams; ++s) {
+    order[s] = s;
+  }
+  std::vector<std::pair<size_t, Hit>> pushes;
+  pushes.reserve(hits + 140 * streams);
+  while (pushes.size() < hits) {
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t s : order) {
+      for (int k = 0; k < 140; ++k) {
+        time[s] += 1 + rng() % 400;
+        uint64_t t = time[s];
+        if (shuffle > 0 && rng() % shuffle == 0) {
+          t -= std::min(t, rng() % window);
+        }
+        pushes.emplace_back(s, Hit{t});
+      }
+    }
+  }
+  return pushes;
+}
+
+static void run(const char *name, size_t streams, size_t hits, unsigned shuffle, int reps) {
+  const uint64_t window = 200000;
+  std::vector<std::pair<size_t, Hit>> pushes = input(streams, hits, shuffle, window);
+  uint64_t merged = 0;
+  uint64_t late = 0;
+  uint64_t checksum = 0;
+  double seconds = bench::time([&]() {
+    for (int r = 0; r < reps; ++r) {
+      jadaq::time_merge<Hit> merge(window);
+      for (size_t i = 0; i < streams; ++i) {
+        merge.add_stream();
+      }
+      uint64_t sum = 0;
+      auto sink = [&sum](const Hit &h) { sum += h.time; };
+      for (size_t i = 0; i < pushes.size(); ++i) {
+        merge.push(pushes[i].first, pushes[i].second);
+        // drain once per readout, as DataWriterMerge does
+        if (i % 140 == 139) {
+          merge.drain(sink);
+        }
+      }
+      merge.flush(sink);
+      merged += merge.merged();
+      checksum += sum;
+      late += merge.late();
+    }
+  });
+  bench::report(name, merged, seconds, "hits");
+  printf("%-24s %10.3f %% late (checksum %" PRIx64 ")\n", "", 100.0 * late / merged, checksum);
+}
+
+int main(int argc, char **argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 10;
+  run("in order", 64, 1000000, 0, reps);
+  run("1 in 100 jittered", 64, 1000000, 100, reps);
+  run("all jittered", 64, 1000000, 1, reps);
+  return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Waveforms per second decoding DPP-QDC mixed-mode waveforms of 450
+ * samples (RecordLength=450) with each kernel. The kernels are local to
+ * DPPQDCEvent.cpp, so it is compiled in.
+ *
+ */
+
+#include "../src/DPPQDCEvent.cpp"
+#include "bench.hpp"
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+  long reps = argc > 1 ? atol(argv[1]) : 2000000;
+  const size_t words = 225;
+  std::mt19937 rng(1);
+  std::vector<uint32_t> data(words);
+  for (uint32_t &w : data) {
+    w = rng() & 0x0fff0fffu;
+  }
+  // gate and overthreshold over part of the record, one trigger
+  for (size_t i = 60; i < 120; ++i) {
+    data[i] |= 0x90009000u;
+  }
+  data[70] |= 0x2000u;
+  std::vector<char> storage(DPPQDCWaveform::size(2 * words));
+  DPPQDCWaveform &waveform = *reinterpret_cast<DPPQDCWaveform *>(storage.data());
+
+  struct {
+    const char *name;
+    WaveformKernel run;
+    bool supported;
+  } kernels[] = {{"scalar", waveformScalar, true}
+#if defined(__x86_64__) || defined(__i386__)
+                 ,
+                 {"sse2", waveformSSE2, (bool)__builtin_cpu_supports("sse2")},
+                 {"avx2", waveformAVX2, (bool)__builtin_cpu_supports("avx2")}
+#endif
+  };
+  for (const auto &kernel : kernels) {
+    if (!kernel.supported) {
+      printf("%-24s not supported by this CPU\n", kernel.name);
+      continue;
+    }
+    double seconds = bench::time([&]() {
+      for (long r = 0; r < reps; ++r) {
+        kernel.run(data.data(), words, waveform);
+        asm volatile("" : : "r"(storage.data()) : "memory");
+      }
+    });
+    bench::report(kernel.name, reps, seconds, "waveforms");
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Check that decoding group aggregates into columns gives the same time,
+ * channel, charge and baseline as decoding them event by event into
+ * ListElement422 and ListElement8222, also when the columns run full in the
+ * middle of a group.
+ *
+ */
+
+#include "DataFormat.hpp"
+#include "EventIterator.hpp"
+#include "bench.hpp"
+#include "columns.hpp"
+#include <cstdio>
+#include <type_traits>
+
+namespace {
+uint16_t baseline(const Data::ListElement422 &) { return 0; }
+uint16_t baseline(const Data::ListElement8222 &element) { return element.baseline; }
+
+template <typename E> unsigned long check(size_t capacity) {
+  const bool extras = E::type() == Data::List8222;
+  // group 2 missing, to check the group numbers
+  bench::DPPQDCBlock block(16, 0xfb, 256, extras);
+  jadaq::columns columns(capacity);
+  unsigned long events = 0;
+  unsigned long mismatches = 0;
+  DPPQDCEventIterator it(block.buffer());
+  DPPQDCEventIterator reference(block.buffer());
+  while (it != it.end()) {
+    columns.clear();
+    uint16_t group = it.group();
+    size_t n = it.decodeGroup(columns);
+    for (size_t i = 0; i < n; ++i, ++reference) {
+      E element(reference.template event<typename E::EventType>(), reference.group());
+      if (reference.group() != group || element.time != columns.time()[i] ||
+          element.channel != columns.channel()[i] || element.charge != columns.charge()[i] ||
+          baseline(element) != columns.baseline()[i]) {
+        if (mismatches == 0) {
+          printf("event %lu differs\n", events + i);
+        }
+        mismatches += 1;
+      }
+    }
+    events += n;
+  }
+  if (reference != reference.end()) {
+    printf("columns ended before the events\n");
+    mismatches += 1;
+  }
+  printf("%-4s columns of %4zu: %lu events, %lu differ\n", extras ? "8222" : "422", capacity,
+         events, mismatches);
+  return mismatches;
+}
+} // namespace
+
+int main() {
+  unsigned long mismatches = 0;
+  for (size_t capacity : {1, 100, 256, 4096}) {
+    mismatches += check<Data::ListElement422>(capacity);
+    mismatches += check<Data::ListElement8222>(capacity);
+  }
+  return mismatches != 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Checks the time ordered merge against a plain search of all pending items:
+ * streams added along the way and closed, times moved back within and beyond
+ * the reorder window, repeated times and random drains must give the same
+ * items in the same order, with the same count of late ones.
+ *
+ */
+
+#include "merge.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+
+struct Hit {
+  uint64_t time;
+  uint64_t id;
+};
+
+/* Emits the items pushed after a later one was emitted, by time, then
+ * arrival, and then the earliest pending item, by time, then stream, then
+ * arrival */
+class Reference {
+  struct Pending {
+    Hit hit;
+    size_t stream;
+  };
+  std::vector<Pending> pending;
+  std::vector<Hit> overdue;
+  std::vector<uint64_t> latest;
+  uint64_t window;
+  uint64_t newest = 0;
+  uint64_t last = 0;
+
+public:
+  uint64_t late = 0;
+  explicit Reference(uint64_t window) : window(window) {}
+  void add_stream() { latest.push_back(0); }
+  void close_stream(size_t s) { latest[s] = std::numeric_limits<uint64_t>::max(); }
+  void push(size_t s, const Hit &h) {
+    newest = std::max(newest, h.time);
+    latest[s] = std::max(latest[s], h.time);
+    if (h.time < last) {
+      overdue.push_back(h);
+    } else {
+      pending.push_back(Pending{h, s});
+    }
+  }
+  void emitUpTo(uint64_t limit, std::vector<uint64_t> &out) {
+    while (!overdue.empty()) {
+      size_t first = 0;
+      for (size_t i = 1; i < overdue.size(); ++i) {
+        if (overdue[i].time < overdue[first].time) {
+          first = i;
+        }
+      }
+      late += 1;
+      out.push_back(overdue[first].id);
+      overdue.erase(overdue.begin() + first);
+    }
+    for (;;) {
+      size_t best = pending.size();
+      for (size_t i = 0; i < pending.size(); ++i) {
+        const Pending &p = pending[i];
+        if (p.hit.time <= limit &&
+            (best == pending.size() || p.hit.time < pending[best].hit.time ||
+             (p.hit.time == pending[best].hit.time && p.stream < pending[best].stream))) {
+          best = i;
+        }
+      }
+      if (best == pending.size()) {
+        return;
+      }
+      last = pending[best].hit.time;
+      out.push_back(pending[best].hit.id);
+      pending.erase(pending.begin() + best);
+    }
+  }
+  uint64_t watermark() const {
+    uint64_t slowest = std::numeric_limits<uint64_t>::max();
+    for (uint64_t l : latest) {
+      slowest = std::min(slowest, l);
+    }
+    uint64_t bound = newest > window ? newest - window : 0;
+    return latest.empty() ? bound : std::max(bound, slowest);
+  }
+};
+
+static bool check(unsigned seed, size_t streams, unsigned shuffle) {
+  const uint64_t window = 1000;
+  std::mt19937_64 rng(seed);
+  jadaq::time_merge<Hit> merge(window);
+  Reference reference(window);
+  size_t added = 0;
+  uint64_t clock = 0;
+  std::vector<uint64_t> got, want;
+  auto collect = [&got](const Hit &h) { got.push_back(h.id); };
+  for (uint64_t id = 0; id < 20000; ++id) {
+    if (added < streams && (added == 0 || rng() % 500 == 0)) {
+      merge.add_stream();
+      reference.add_stream();
+      added += 1;
+    }
+    size_t s = rng() % added;
+    // few distinct steps, so times repeat within and across streams
+    clock += rng() % 4 * 10;
+    uint64_t t = clock - std::min<uint64_t>(clock, rng() % 20 * 10);
+    if (shuffle > 0 && rng() % shuffle == 0) {
+      t -= std::min(t, rng() % (2 * window));
+    }
+    merge.push(s, Hit{t, id});
+    reference.push(s, Hit{t, id});
+    if (rng() % 50 == 0) {
+      merge.drain(collect);
+      reference.emitUpTo(reference.watermark(), want);
+    }
+    if (rng() % 5000 == 0) {
+      merge.close_stream(s);
+      reference.close_stream(s);
+    }
+  }
+  merge.flush(collect);
+  reference.emitUpTo(std::numeric_limits<uint64_t>::max(), want);
+  bool ok = got == want && merge.late() == reference.late && merge.pending() == 0 &&
+            merge.merged() == want.size();
+  printf("seed %u, %zu streams, 1 in %u moved back: %zu hits, %" PRIu64 " late - %s\n", seed,
+         streams, shuffle, got.size(), merge.late(), ok ? "ok" : "differ");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (unsigned seed = 1; seed <= 4; ++seed) {
+    ok &= check(seed, 1, 0);
+    ok &= check(seed, 7, 0);
+    ok &= check(seed, 7, 10);
+    ok &= check(seed, 33, 3);
+  }
+  return ok ? 0 : 1;
+}
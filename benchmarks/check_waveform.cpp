@@ -0,0 +1,161 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Check that the vector kernels decoding DPP-QDC mixed-mode waveforms give
+ * the same samples, trigger and probe intervals as the scalar reference, on
+ * random words and on probe edges around the 32-word blocks the kernels
+ * work in. The kernels are local to DPPQDCEvent.cpp, so it is compiled in.
+ *
+ */
+
+#include "../src/DPPQDCEvent.cpp"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+const size_t maxWords = 600;
+
+struct Kernel {
+  const char *name;
+  WaveformKernel run;
+  unsigned long mismatches;
+};
+
+class Checker {
+private:
+  std::vector<Kernel> kernels;
+  std::vector<char> expected;
+  std::vector<char> actual;
+  unsigned long cases = 0;
+
+public:
+  Checker()
+      : expected(DPPQDCWaveform::size(2 * maxWords)),
+        actual(DPPQDCWaveform::size(2 * maxWords)) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+      kernels.push_back(Kernel{"sse2", waveformSSE2, 0});
+    } else {
+      printf("sse2 not supported by this CPU, not checked\n");
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      kernels.push_back(Kernel{"avx2", waveformAVX2, 0});
+    } else {
+      printf("avx2 not supported by this CPU, not checked\n");
+    }
+#endif
+  }
+
+  /* Everything up to the last sample, and garbage in what is not written */
+  void check(const std::vector<uint32_t> &words, size_t n, const char *what) {
+    size_t bytes = DPPQDCWaveform::size(2 * n);
+    memset(expected.data(), 0x5a, expected.size());
+    waveformScalar(words.data(), n, *reinterpret_cast<DPPQDCWaveform *>(expected.data()));
+    for (Kernel &kernel : kernels) {
+      memset(actual.data(), 0x5a, actual.size());
+      kernel.run(words.data(), n, *reinterpret_cast<DPPQDCWaveform *>(actual.data()));
+      if (memcmp(expected.data(), actual.data(), bytes) != 0) {
+        if (kernel.mismatches == 0) {
+          printf("%s differs from scalar: %s, %zu words\n", kernel.name, what, n);
+        }
+        kernel.mismatches += 1;
+      }
+    }
+    cases += 1;
+  }
+
+  int result() const {
+    int failed = 0;
+    for (const Kernel &kernel : kernels) {
+      printf("%-5s %lu of %lu cases differ\n", kernel.name, kernel.mismatches, cases);
+      failed |= kernel.mismatches != 0;
+    }
+    return failed;
+  }
+};
+
+/* Set probe bit p on samples first to last */
+void window(std::vector<uint32_t> &words, unsigned p, size_t first, size_t last) {
+  for (size_t s = first; s <= last; ++s) {
+    words[s >> 1] |= 1u << ((s & 1 ? 28 : 12) + p);
+  }
+}
+} // namespace
+
+int main() {
+  Checker checker;
+  std::mt19937 rng(1);
+  std::vector<uint32_t> words(maxWords);
+
+  // Random words, with all probes, sparse probes and no probes
+  for (int i = 0; i < 100000; ++i) {
+    size_t n = rng() % 300;
+    for (size_t k = 0; k < n; ++k) {
+      uint32_t w = rng();
+      switch (i % 3) {
+      case 1:
+        w &= 0x0fff0fffu;
+        if (rng() % 16 == 0) {
+          w |= rng() & 0xf000u;
+        }
+        if (rng() % 16 == 0) {
+          w |= rng() & 0xf0000000u;
+        }
+        break;
+      case 2:
+        w &= 0x0fff0fffu;
+        break;
+      }
+      words[k] = w;
+    }
+    checker.check(words, n, "random words");
+  }
+
+  // One probe high over a window of samples starting and ending next to the
+  // block boundaries, on either sample of a word
+  const size_t edges[] = {0, 1, 2, 61, 62, 63, 64, 65, 66, 127, 128, 129, 130, 449};
+  const size_t lengths[] = {1, 31, 32, 33, 63, 64, 65, 225, 512};
+  for (size_t n : lengths) {
+    for (unsigned p = 0; p < 4; ++p) {
+      for (size_t first : edges) {
+        for (size_t last : edges) {
+          if (first > last || last >= 2 * n) {
+            continue;
+          }
+          for (size_t k = 0; k < n; ++k) {
+            words[k] = rng() & 0x0fff0fffu;
+          }
+          window(words, p, first, last);
+          checker.check(words, n, "probe window");
+          // and a second window further on
+          if (last + 3 < 2 * n) {
+            window(words, p, last + 2, std::min(2 * n - 1, last + 2 + (rng() % 70)));
+            checker.check(words, n, "two probe windows");
+          }
+        }
+      }
+    }
+  }
+  return checker.result();
+}
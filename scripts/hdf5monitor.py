@@ -33,6 +33,36 @@ def show_waveformelem_struct(name, data):
         key = "%s_name" % field
         print "    %s %d" % (field, data[0][key])
 
+# Datasets of the columns layout, one per field of a list element
+column_fields = ['time', 'channel', 'charge', 'baseline']
+
+def follow_appended(root, seen):
+    """Print what was added to the datasets of the appended or columns layout
+    since the last call. jadaq writes an index row only once the data it
+    refers to is in the file, so the index never runs ahead of the data."""
+    for (key, group) in root.items():
+        if 'data' in group:
+            datasets = [(None, group['data'])]
+        else:
+            datasets = [(f, group[f]) for f in column_fields if f in group]
+        if not datasets:
+            continue
+        for (field, dataset) in datasets:
+            dataset.refresh()
+        # The columns may be flushed a few rows apart
+        rows = min(dataset.shape[0] for (field, dataset) in datasets)
+        first = seen.get(key, 0)
+        if rows > first:
+            print "Digitizer %s: %d rows, %d new" % (key, rows, rows - first)
+            for (field, dataset) in datasets:
+                last = dataset[rows - 1]
+                if field is not None:
+                    print "    %s %s" % (field, last)
+                    continue
+                for name in dataset.dtype.names or []:
+                    print "    %s %s" % (name, last[name])
+        seen[key] = rows
+
 def show_entries(root):
     """Print out the contents of root and recursively apply to nested items"""
     
@@ -67,8 +97,14 @@ if __name__ == '__main__':
         print "Are you sure it is a HDF5 file created/opened in SWMR mode?"
         sys.exit(1)
     root = h5file["/"]
+    # The appended and columns layouts have an index in every group
+    appended = any('index' in group for group in root.values())
+    seen = {}
     while True:
-        print "Display contents"
-        show_entries(root)
-        print
+        if appended:
+            follow_appended(root, seen)
+        else:
+            print "Display contents"
+            show_entries(root)
+            print
         time.sleep(2)
@@ -27,8 +27,10 @@
 
 #include "Configuration.hpp"
 #include "StringConversion.hpp"
+#include "parallel.hpp"
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <regex>
 #include "xtrace.h"
 
@@ -119,6 +121,9 @@ pt::ptree Configuration::readBack() {
     }
     dPtree.put("VME", hex_string(digitizer.VMEBaseAddress));
     dPtree.put("CONET", digitizer.conetNode);
+    if (digitizer.core >= 0) {
+      dPtree.put("CORE", digitizer.core);
+    }
 
     for (FunctionID id = functionIDbegin(); id < functionIDend(); ++id) {
       if (!takeIndex(id)) {
@@ -215,6 +220,17 @@ static void configure(Digitizer &digitizer, pt::ptree &conf, bool verbose) {
 
 void Configuration::apply() {
   XTRACE(CONF, DEB, "Configuration::apply()");
+  struct Setup {
+    CAEN_DGTZ_ConnectionType linkType;
+    int linkNum;
+    int conet;
+    uint32_t vme;
+    int core;
+    bool configure;
+    pt::ptree conf;
+  };
+  std::vector<Setup> setups;
+  std::vector<std::pair<int, int> > links;
   for (auto &section : in) {
     std::string name = section.first;
     XTRACE(CONF, DEB, "Section %s", name.c_str());
@@ -233,28 +249,37 @@ void Configuration::apply() {
     conf.erase("VME");
     conet = conf.get<int>("CONET", 0);
     conf.erase("CONET");
-    Digitizer *digitizer = nullptr;
+    int core = conf.get<int>("CORE", -1);
+    conf.erase("CORE");
     if (usb < 0 && optical < 0) {
       XTRACE(CONF, ERR, "ERROR: [%s] contains neither USB nor OPTICAL number. One is REQUIRED.", name.c_str());
-      digitizers.emplace_back((CAEN_DGTZ_ConnectionType)ECDC_NULL_CONNECTION, optical, conet, vme);
-      continue;
+      setups.push_back({(CAEN_DGTZ_ConnectionType)ECDC_NULL_CONNECTION, optical, conet, vme, core, false, conf});
     } else if (usb >= 0 && optical >= 0) {
       XTRACE(CONF, ERR, "ERROR: [%s] contains both USB and OPTICAL number. Only one is VALID.", name.c_str());
-      digitizers.emplace_back((CAEN_DGTZ_ConnectionType)ECDC_NULL_CONNECTION, optical, conet, vme);
-      continue;
+      setups.push_back({(CAEN_DGTZ_ConnectionType)ECDC_NULL_CONNECTION, optical, conet, vme, core, false, conf});
+    } else if (optical >= 0) {
+      setups.push_back({CAEN_DGTZ_OpticalLink, optical, conet, vme, core, true, conf});
+    } else {
+      setups.push_back({CAEN_DGTZ_USB, usb, conet, vme, core, true, conf});
     }
-    // try {
-      if (optical >= 0) {
-        digitizers.emplace_back(CAEN_DGTZ_OpticalLink, optical, conet, vme);
-      } else {
-        digitizers.emplace_back(CAEN_DGTZ_USB, usb, conet, vme);
-      }
-      digitizer = &*digitizers.rbegin();
-    // } catch (caen::Error &e) {
-    //   XTRACE(MAIN, ERR, "ERROR: Unable to open digitizer [%s]:", name.c_str(), e.what());
-    //   throw;
-    // }
-    configure(*digitizer, conf, getVerbose());
+    links.emplace_back(setups.back().linkType, setups.back().linkNum);
+  }
+
+  /* Opening, resetting and configuring a digitizer takes a while. Digitizers
+   * sharing a link have to be handled one after the other, but separate
+   * links are handled in parallel. */
+  std::vector<std::unique_ptr<Digitizer> > opened(setups.size());
+  jadaq::parallel_by_key(links, [this, &setups, &opened](size_t i) {
+    Setup &setup = setups[i];
+    opened[i].reset(new Digitizer(setup.linkType, setup.linkNum, setup.conet, setup.vme));
+    opened[i]->core = setup.core;
+    if (setup.configure) {
+      configure(*opened[i], setup.conf, getVerbose());
+    }
+  });
+  digitizers.reserve(opened.size());
+  for (std::unique_ptr<Digitizer> &digitizer : opened) {
+    digitizers.push_back(std::move(*digitizer));
   }
 }
 
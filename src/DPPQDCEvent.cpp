@@ -27,6 +27,10 @@
 #include "DPPQDCEvent.hpp"
 #include "Waveform.hpp"
 #include <cassert>
+#include <cstddef>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define DVP(V, S)                                                              \
   {                                                                            \
@@ -43,17 +47,22 @@
     }                                                                          \
   }
 
-/** DPP QDC on XX740 digitizer mixed-mode waveform decoding */
-template <typename DPPQDCEventType>
-static inline void waveform_(const DPPQDCEventWaveform<DPPQDCEventType>& event,
-                             DPPQDCWaveform& waveform){
-  size_t n = (event.size - (2 + event.extras)) << 1;
+/* DPP QDC on XX740 digitizer mixed-mode waveform words hold two samples, the
+ * even one in the low half word. Each half word has a 12-bit sample value in
+ * bits 0-11 followed by the digital probes: gate (12), trigger (13),
+ * holdoff (14) and overthreshold (15). */
+typedef void (*WaveformKernel)(const uint32_t *words, size_t nWords,
+                               DPPQDCWaveform &waveform);
+
+/** Reference implementation, one word at a time */
+static void waveformScalar(const uint32_t *words, size_t nWords,
+                           DPPQDCWaveform &waveform) {
   uint16_t trigger = 0xFFFF;
   Interval gate = {0xffff, 0xffff};
   Interval holdoff = {0xffff, 0xffff};
   Interval over = {0xffff, 0xffff};
-  for (uint16_t i = 0; i < (n >> 1); ++i) {
-    uint32_t ss = event.ptr[i + 1];
+  for (uint16_t i = 0; i < nWords; ++i) {
+    uint32_t ss = words[i];
     waveform.samples[i << 1] = (uint16_t)(ss & 0x0fff);
     waveform.samples[i << 1 | 1] = (uint16_t)((ss >> 16) & 0x0fff);
     // trigger
@@ -64,13 +73,173 @@ static inline void waveform_(const DPPQDCEventWaveform<DPPQDCEventType>& event,
     DVP(holdoff, 2)
     DVP(over, 3)
   }
-  waveform.num_samples = n;
   waveform.trigger = trigger;
   waveform.gate = gate;
   waveform.holdoff = holdoff;
   waveform.overthreshold = over;
 }
 
+namespace {
+/* Digital probe bits of a block of up to 32 consecutive words: bit k of
+ * lo[p] (hi[p]) is probe p of the even (odd) sample of word k */
+struct ProbeMasks {
+  uint32_t lo[4] = {0, 0, 0, 0};
+  uint32_t hi[4] = {0, 0, 0, 0};
+};
+
+/* Trigger and intervals accumulated block by block. Gives the same result as
+ * running DVP over every word of the block, but only looks at the first and
+ * last word where something changes. */
+struct ProbeState {
+  uint16_t trigger = 0xffff;
+  Interval gate = {0xffff, 0xffff};
+  Interval holdoff = {0xffff, 0xffff};
+  Interval over = {0xffff, 0xffff};
+
+  static void interval(Interval &V, size_t base, uint32_t lo, uint32_t hi,
+                       uint32_t valid) {
+    // DVP moves the end to every word where the probe is not high on both
+    // samples once the interval has started
+    uint32_t update = ~(lo & hi) & valid;
+    if (V.start == 0xffffu) {
+      uint32_t any = lo | hi;
+      if (any == 0) {
+        return;
+      }
+      unsigned f = __builtin_ctz(any);
+      V.start = (uint16_t)(((base + f) << 1) | ((hi >> f) & 1u));
+      if (((hi >> f) & 1u) == 0) {
+        V.end = (uint16_t)(((base + f) << 1) | 1);
+      }
+      update &= ~((2u << f) - 1);
+    }
+    if (update) {
+      unsigned l = 31 - __builtin_clz(update);
+      V.end = (uint16_t)(((base + l) << 1) | ((hi >> l) & 1u));
+    }
+  }
+
+  void apply(const ProbeMasks &m, size_t base, uint32_t valid) {
+    if (uint32_t t = m.lo[1] | m.hi[1]) {
+      unsigned l = 31 - __builtin_clz(t);
+      trigger = (uint16_t)(((base + l) << 1) | ((m.hi[1] >> l) & 1u));
+    }
+    interval(gate, base, m.lo[0], m.hi[0], valid);
+    interval(holdoff, base, m.lo[2], m.hi[2], valid);
+    interval(over, base, m.lo[3], m.hi[3], valid);
+  }
+
+  void store(DPPQDCWaveform &waveform) const {
+    waveform.trigger = trigger;
+    waveform.gate = gate;
+    waveform.holdoff = holdoff;
+    waveform.overthreshold = over;
+  }
+};
+} // namespace
+
+/* Decode count < 32 words starting at base without vector instructions */
+static inline void waveformBlock(const uint32_t *words, size_t base,
+                                 unsigned count, DPPQDCWaveform &waveform,
+                                 ProbeState &state) {
+  ProbeMasks m;
+  for (unsigned k = 0; k < count; ++k) {
+    uint32_t ss = words[base + k];
+    waveform.samples[(base + k) << 1] = (uint16_t)(ss & 0x0fff);
+    waveform.samples[(base + k) << 1 | 1] = (uint16_t)((ss >> 16) & 0x0fff);
+    for (unsigned p = 0; p < 4; ++p) {
+      m.lo[p] |= ((ss >> (12 + p)) & 1u) << k;
+      m.hi[p] |= ((ss >> (28 + p)) & 1u) << k;
+    }
+  }
+  state.apply(m, base, (1u << count) - 1);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The vector kernels mask out the samples of a whole vector of words at once
+ * and use movemask to collect one probe bit per word into ProbeMasks. The
+ * shift moves probe bit 12+p (28+p) of every word into the sign bit. */
+#define PROBE_MASKS(MOVEMASK, SLLI, W, K, M)                                   \
+  (M).lo[0] |= (uint32_t)MOVEMASK(SLLI((W), 19)) << (K);                       \
+  (M).hi[0] |= (uint32_t)MOVEMASK(SLLI((W), 3)) << (K);                        \
+  (M).lo[1] |= (uint32_t)MOVEMASK(SLLI((W), 18)) << (K);                       \
+  (M).hi[1] |= (uint32_t)MOVEMASK(SLLI((W), 2)) << (K);                        \
+  (M).lo[2] |= (uint32_t)MOVEMASK(SLLI((W), 17)) << (K);                       \
+  (M).hi[2] |= (uint32_t)MOVEMASK(SLLI((W), 1)) << (K);                        \
+  (M).lo[3] |= (uint32_t)MOVEMASK(SLLI((W), 16)) << (K);                       \
+  (M).hi[3] |= (uint32_t)MOVEMASK((W)) << (K);
+
+#define MOVEMASK_SSE(V) _mm_movemask_ps(_mm_castsi128_ps(V))
+#define MOVEMASK_AVX2(V) _mm256_movemask_ps(_mm256_castsi256_ps(V))
+
+__attribute__((target("sse2"))) static void
+waveformSSE2(const uint32_t *words, size_t nWords, DPPQDCWaveform &waveform) {
+  char *samples = reinterpret_cast<char *>(&waveform) +
+                  offsetof(DPPQDCWaveform, samples);
+  const __m128i sampleMask = _mm_set1_epi32(0x0fff0fff);
+  ProbeState state;
+  size_t i = 0;
+  for (; nWords - i >= 32; i += 32) {
+    ProbeMasks m;
+    for (unsigned k = 0; k < 32; k += 4) {
+      __m128i w = _mm_loadu_si128((const __m128i *)(words + i + k));
+      _mm_storeu_si128((__m128i *)(samples + ((i + k) << 2)),
+                       _mm_and_si128(w, sampleMask));
+      PROBE_MASKS(MOVEMASK_SSE, _mm_slli_epi32, w, k, m)
+    }
+    state.apply(m, i, 0xffffffffu);
+  }
+  waveformBlock(words, i, (unsigned)(nWords - i), waveform, state);
+  state.store(waveform);
+}
+
+__attribute__((target("avx2"))) static void
+waveformAVX2(const uint32_t *words, size_t nWords, DPPQDCWaveform &waveform) {
+  char *samples = reinterpret_cast<char *>(&waveform) +
+                  offsetof(DPPQDCWaveform, samples);
+  const __m256i sampleMask = _mm256_set1_epi32(0x0fff0fff);
+  ProbeState state;
+  size_t i = 0;
+  for (; nWords - i >= 32; i += 32) {
+    ProbeMasks m;
+    for (unsigned k = 0; k < 32; k += 8) {
+      __m256i w = _mm256_loadu_si256((const __m256i *)(words + i + k));
+      _mm256_storeu_si256((__m256i *)(samples + ((i + k) << 2)),
+                          _mm256_and_si256(w, sampleMask));
+      PROBE_MASKS(MOVEMASK_AVX2, _mm256_slli_epi32, w, k, m)
+    }
+    state.apply(m, i, 0xffffffffu);
+  }
+  waveformBlock(words, i, (unsigned)(nWords - i), waveform, state);
+  state.store(waveform);
+}
+#endif
+
+/* Pick the widest kernel the CPU supports, once at startup */
+static WaveformKernel selectWaveformKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return waveformAVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return waveformSSE2;
+  }
+#endif
+  return waveformScalar;
+}
+
+static const WaveformKernel waveformKernel = selectWaveformKernel();
+
+/** DPP QDC on XX740 digitizer mixed-mode waveform decoding */
+template <typename DPPQDCEventType>
+static inline void waveform_(const DPPQDCEventWaveform<DPPQDCEventType>& event,
+                             DPPQDCWaveform& waveform){
+  size_t n = (event.size - (2 + event.extras)) << 1;
+  waveformKernel(event.ptr + 1, n >> 1, waveform);
+  waveform.num_samples = n;
+}
+
 template <>
 void DPPQDCEventWaveform<DPPQDCEvent>::waveform(DPPQDCWaveform &waveform) const{
     waveform_(*this,waveform);
@@ -81,32 +250,155 @@ void DPPQDCEventWaveform<DPPQDCEventExtra>::waveform(DPPQDCWaveform &waveform) c
     waveform_(*this,waveform);
 }
 
+/* XX751 standard firmware words hold up to three 10-bit samples, the number
+ * of valid samples is given by bits 30-31. Returns the sample index following
+ * the last sample written. */
+typedef size_t (*UnpackKernel)(const uint32_t *words, size_t nWords,
+                               StdWaveform &waveform, size_t idx);
+
+/** Reference implementation, one word at a time */
+static size_t unpack10Scalar(const uint32_t *words, size_t nWords,
+                             StdWaveform &waveform, size_t idx) {
+  for (size_t i = 0; i < nWords; ++i) {
+    uint32_t ss = words[i];
+    uint8_t nSamples = (uint8_t)((ss >> 30) & 0x03); // # of samples in this word, max three (2-bit value)
+    for (uint8_t s = 0; s < nSamples; ++s) {
+      waveform.samples[idx++] = (uint16_t)((ss >> (s * 10)) & 0x03ff); // 10-bit samples
+    }
+  }
+  return idx;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace {
+/* The vector kernels unpack groups of 8 full words, i.e. 24 samples, as three
+ * blocks of 8 samples. Block b is shuffled from 16 bytes loaded at word
+ * loadWord[b] such that every 16-bit lane holds the two bytes containing its
+ * sample. Sample k of a word starts at bit 2k of those bytes, so multiplying
+ * by 1 << (4 - 2k) lines all of them up at bit 4. */
+struct Unpack10Tables {
+  static constexpr const unsigned loadWord[3] = {0, 2, 4};
+  uint8_t shuffle[3][16];
+  uint16_t multiply[3][8];
+  Unpack10Tables() {
+    for (unsigned b = 0; b < 3; ++b) {
+      for (unsigned j = 0; j < 8; ++j) {
+        unsigned sample = 8 * b + j;
+        unsigned k = sample % 3;
+        unsigned byte = 4 * (sample / 3 - loadWord[b]) + k;
+        shuffle[b][2 * j] = (uint8_t)byte;
+        shuffle[b][2 * j + 1] = (uint8_t)(byte + 1);
+        multiply[b][j] = (uint16_t)(1u << (4 - 2 * k));
+      }
+    }
+  }
+};
+constexpr const unsigned Unpack10Tables::loadWord[3];
+const Unpack10Tables unpack10Tables;
+} // namespace
+
+__attribute__((target("ssse3"))) static inline __m128i
+unpack10Block(const uint32_t *words, unsigned b) {
+  __m128i w = _mm_loadu_si128(
+      (const __m128i *)(words + Unpack10Tables::loadWord[b]));
+  w = _mm_shuffle_epi8(
+      w, _mm_loadu_si128((const __m128i *)unpack10Tables.shuffle[b]));
+  w = _mm_mullo_epi16(
+      w, _mm_loadu_si128((const __m128i *)unpack10Tables.multiply[b]));
+  return _mm_and_si128(_mm_srli_epi16(w, 4), _mm_set1_epi16(0x03ff));
+}
+
+__attribute__((target("ssse3"))) static size_t
+unpack10SSSE3(const uint32_t *words, size_t nWords, StdWaveform &waveform,
+              size_t idx) {
+  char *samples = reinterpret_cast<char *>(&waveform) +
+                  offsetof(StdWaveform, samples);
+  size_t i = 0;
+  for (; nWords - i >= 8; i += 8) {
+    // all 8 words must hold 3 samples
+    __m128i full = _mm_and_si128(_mm_loadu_si128((const __m128i *)(words + i)),
+                                 _mm_loadu_si128((const __m128i *)(words + i + 4)));
+    if ((_mm_movemask_ps(_mm_castsi128_ps(full)) &
+         _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(full, 1)))) != 0xf) {
+      idx = unpack10Scalar(words + i, 8, waveform, idx);
+      continue;
+    }
+    for (unsigned b = 0; b < 3; ++b) {
+      _mm_storeu_si128((__m128i *)(samples + ((idx + 8 * b) << 1)),
+                       unpack10Block(words + i, b));
+    }
+    idx += 24;
+  }
+  return unpack10Scalar(words + i, nWords - i, waveform, idx);
+}
+
+__attribute__((target("avx2"))) static size_t
+unpack10AVX2(const uint32_t *words, size_t nWords, StdWaveform &waveform,
+             size_t idx) {
+  char *samples = reinterpret_cast<char *>(&waveform) +
+                  offsetof(StdWaveform, samples);
+  const __m256i shuffle = _mm256_loadu_si256((const __m256i *)unpack10Tables.shuffle[0]);
+  const __m256i multiply = _mm256_loadu_si256((const __m256i *)unpack10Tables.multiply[0]);
+  size_t i = 0;
+  for (; nWords - i >= 8; i += 8) {
+    // all 8 words must hold 3 samples
+    __m256i full = _mm256_loadu_si256((const __m256i *)(words + i));
+    if ((_mm256_movemask_ps(_mm256_castsi256_ps(full)) &
+         _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(full, 1)))) != 0xff) {
+      idx = unpack10Scalar(words + i, 8, waveform, idx);
+      continue;
+    }
+    // blocks 0 and 1 in the two lanes of one register, block 2 on its own
+    __m256i w = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(
+            (const __m128i *)(words + i + Unpack10Tables::loadWord[0]))),
+        _mm_loadu_si128((const __m128i *)(words + i + Unpack10Tables::loadWord[1])), 1);
+    w = _mm256_mullo_epi16(_mm256_shuffle_epi8(w, shuffle), multiply);
+    _mm256_storeu_si256((__m256i *)(samples + (idx << 1)),
+                        _mm256_and_si256(_mm256_srli_epi16(w, 4), _mm256_set1_epi16(0x03ff)));
+    _mm_storeu_si128((__m128i *)(samples + ((idx + 16) << 1)),
+                     unpack10Block(words + i, 2));
+    idx += 24;
+  }
+  return unpack10Scalar(words + i, nWords - i, waveform, idx);
+}
+#endif
+
+/* Pick the widest kernel the CPU supports, once at startup */
+static UnpackKernel selectUnpackKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return unpack10AVX2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return unpack10SSSE3;
+  }
+#endif
+  return unpack10Scalar;
+}
+
+static const UnpackKernel unpack10 = selectUnpackKernel();
+
 template <>
 void StdEventWaveform<StdEvent751>::waveform(StdWaveform &waveform) const
 {
-  //  waveform_(*this,waveform);
-  size_t nActiveChannel = std::bitset<8>(channelMask()).count(); // # of active channels given by mask
+  size_t nActiveChannel = activeChannels();
   size_t nWords = (size - 4); // number of words with samples: (event size - header)
-  assert((nWords % nActiveChannel) == 0); // double-check that total size adds up
-
-  // determine the number of trailing samples in each channel data block from last word of first channel data block:
-  // NOTE: assumed to be the same for all channels
-  // uint8_t nTrailingSamples = (uint8_t)((event.prt[4+((uint16_t) nWords/nActiveChannel) - 1] >> 30) & 0x0002 );
-
-  uint16_t idx = 0;
 
-  for (uint16_t i = 0; i < (nWords); ++i)
+  // Only the last word of each channel block may hold fewer than three
+  // samples, so unpack channel by channel to keep the vector kernel busy
+  size_t idx = 0;
+  for (size_t c = 0; c < nActiveChannel; ++c)
     {
-      uint32_t ss = ptr[i+4]; // current word after header
-      // current sample index calculated from 3 samples per word minus those
-      // possibly missing in the trailing word of each channel block
-      // uint16_t idx = i * 3 - ((uint16_t) i / (nWords / nActiveChannel))*( 3 - nTrailingSamples );
-
-      uint8_t nSamples = (uint8_t)((ss >> 30) & 0x03 ); // # of samples in this word, max three (2-bit value)
-
-      for (uint8_t s = 0; s < nSamples; ++s){
-        waveform.samples[idx++] = (uint16_t)((ss>>(s*10)) & 0x03ff); // 10-bit samples
-      }
+      idx = unpack10(channelData(c), channelWords(), waveform, idx);
+    }
+  // Words that do not add up to whole channel blocks, or all of them without
+  // a channel enabled, are unpacked as one stream like before
+  size_t rest = nWords - nActiveChannel * channelWords();
+  if (rest > 0)
+    {
+      idx = unpack10Scalar(ptr + 4 + nWords - rest, rest, waveform, idx);
     }
   waveform.num_samples = idx;
 }
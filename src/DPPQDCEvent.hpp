@@ -64,6 +64,12 @@ struct StdEvent751: Event {
   uint8_t channelMask() const { return (uint8_t)(ptr[1] & 0x000000ffu); }
   uint32_t eventNo() const { return (uint32_t)(ptr[2] & 0x00ffffffu);}
   uint32_t timeTag() const { return ptr[3]; }
+  /* The samples follow the 4 word header as one equally sized block of words
+   * per channel enabled in channelMask, in increasing channel order. 0 words
+   * per channel without any enabled. */
+  size_t activeChannels() const { return (size_t)__builtin_popcount(channelMask()); }
+  size_t channelWords() const { return activeChannels() > 0 ? (size - 4) / activeChannels() : 0; }
+  const uint32_t* channelData(size_t block) const { return ptr + 4 + block*channelWords(); }
   static constexpr const bool ettt = false;
 };
 
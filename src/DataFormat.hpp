@@ -33,7 +33,7 @@
 #include <iostream>
 
 constexpr uint8_t version_maj {1};
-constexpr uint8_t version_min {3};
+constexpr uint8_t version_min {4};
 
 #define JUMBO_PAYLOAD 9000
 #define IP_HEADER 20
@@ -49,6 +49,9 @@ namespace Data {
         List422,
         List8222,
         Standard, // non-DPP standard data with waveform
+        Raw, // undecoded readout data, see documentation/dataformat.md
+        Hit, // list mode events from all digitizers merged in time order
+        Event, // hits grouped in coincidence events
         Waveform422 = WaveformBase | List422,
         Waveform8222 = WaveformBase | List8222,
     };
@@ -62,7 +65,7 @@ namespace Data {
         uint16_t numElements;
         uint16_t version;
         uint32_t seqNum;
-        uint8_t __pad[2];
+        uint16_t rollover; // of the 32-bit time tag, see documentation/dataformat.md
     };
     static_assert(std::is_pod<Header>::value, "Data::Header must be POD");
 
@@ -177,6 +180,21 @@ namespace Data {
         {
             return time < rhs.time;
         };
+        /* Every enabled channel has the same number of samples, stored one
+         * channel after the other. The samples of channel ch, which must be
+         * set in channelMask, are waveform.samples[channelOffset(ch)] up to
+         * but not including waveform.samples[channelOffset(ch)+channelSamples()].
+         * 0 without any channel enabled. */
+        uint16_t channelSamples() const
+        {
+            if (channelMask == 0)
+                return 0;
+            return (uint16_t)(waveform.num_samples / __builtin_popcount(channelMask));
+        }
+        size_t channelOffset(uint8_t ch) const
+        {
+            return __builtin_popcount(channelMask & ((1u << ch) - 1)) * (size_t)channelSamples();
+        }
         void printOn(std::ostream& os) const
         {
             os << PRINTD(channelMask) << " " << PRINTD(time) << " " << PRINTD(eventNo) << " ";
@@ -250,6 +268,114 @@ namespace Data {
     static_assert(std::is_pod<DPPQDCWaveformElement<Data::ListElement422> >::value, "Data::DPPQDCWaveformElement<Data::ListElement422> > must be POD");
     static_assert(std::is_pod<DPPQDCWaveformElement<Data::ListElement8222> >::value, "Data::DPPQDCWaveformElement<Data::ListElement8222> > must be POD");
 
+    /* Raw pass-through: the 32-bit words of the readout buffer exactly as they
+     * were read from the digitizer */
+    struct __attribute__ ((__packed__)) RawElement
+    {
+        uint32_t word;
+        void printOn(std::ostream& os) const
+        {
+            os << "0x" << std::hex << std::setfill('0') << std::setw(8) << word
+               << std::setfill(' ') << std::dec;
+        }
+        static ElementType type() { return Raw; }
+        static size_t size() { return sizeof(RawElement); }
+        static size_t size(size_t) { return size(); }
+        static H5::DataType h5type() { return H5::DataType(H5::PredType::NATIVE_UINT32); }
+        static void headerOn(std::ostream& os)
+        {
+            os << "word";
+        }
+    };
+    static_assert(std::is_pod<RawElement>::value, "Data::RawElement must be POD");
+
+    /* One list mode event in the time ordered stream merged from all
+     * digitizers. time is extended to 64 bits, so it keeps increasing across
+     * rollovers of the 32-bit time tag. */
+    struct __attribute__ ((__packed__)) HitElement
+    {
+        uint64_t time;
+        uint32_t digitizerID;
+        uint16_t channel;
+        uint16_t charge;
+        uint16_t baseline; // 0 for ListElement422
+        bool operator< (const HitElement& rhs) const
+        {
+            return time < rhs.time || (time == rhs.time && (digitizerID < rhs.digitizerID ||
+                                        (digitizerID == rhs.digitizerID && channel < rhs.channel)));
+        };
+        void printOn(std::ostream& os) const
+        {
+            os << PRINTD(digitizerID) << " " << PRINTD(channel) << " " << PRINTD(time) << " "
+               << PRINTD(charge) << " " << PRINTD(baseline);
+        }
+        static ElementType type() { return Hit; }
+        static void insertMembers(H5::CompType& datatype, size_t offset = 0)
+        {
+            datatype.insertMember("time", offset + HOFFSET(HitElement, time), H5::PredType::NATIVE_UINT64);
+            datatype.insertMember("digitizerID", offset + HOFFSET(HitElement, digitizerID), H5::PredType::NATIVE_UINT32);
+            datatype.insertMember("channel", offset + HOFFSET(HitElement, channel), H5::PredType::NATIVE_UINT16);
+            datatype.insertMember("charge", offset + HOFFSET(HitElement, charge), H5::PredType::NATIVE_UINT16);
+            datatype.insertMember("baseline", offset + HOFFSET(HitElement, baseline), H5::PredType::NATIVE_UINT16);
+        }
+        static size_t size() { return sizeof(HitElement); }
+        static size_t size(size_t) { return size(); }
+        static H5::CompType h5type()
+        {
+            H5::CompType datatype(size());
+            insertMembers(datatype);
+            return datatype;
+        }
+        static void headerOn(std::ostream& os)
+        {
+            os << PRINTH(digitizerID) << " " << PRINTH(channel) << " " << PRINTH(time) << " "
+               << PRINTH(charge) << " " << PRINTH(baseline);
+        }
+    };
+    static_assert(std::is_pod<HitElement>::value, "Data::HitElement must be POD");
+
+    /* A hit in a coincidence event. The hits of an event follow each other,
+     * all with the same event number and multiplicity. */
+    struct __attribute__ ((__packed__)) EventElement
+    {
+        uint32_t event;
+        uint16_t multiplicity; // hits in the event
+        HitElement hit;
+        bool operator< (const EventElement& rhs) const
+        {
+            return event < rhs.event || (event == rhs.event && hit < rhs.hit);
+        };
+        void printOn(std::ostream& os) const
+        {
+            os << PRINTD(event) << " " << PRINTD(multiplicity) << " ";
+            hit.printOn(os);
+        }
+        static ElementType type() { return Event; }
+        static void insertMembers(H5::CompType& datatype)
+        {
+            datatype.insertMember("event", HOFFSET(EventElement, event), H5::PredType::NATIVE_UINT32);
+            datatype.insertMember("multiplicity", HOFFSET(EventElement, multiplicity), H5::PredType::NATIVE_UINT16);
+            HitElement::insertMembers(datatype, offsetof(EventElement, hit));
+        }
+        static size_t size() { return sizeof(EventElement); }
+        static size_t size(size_t) { return size(); }
+        static H5::CompType h5type()
+        {
+            H5::CompType datatype(size());
+            insertMembers(datatype);
+            return datatype;
+        }
+        static void headerOn(std::ostream& os)
+        {
+            os << PRINTH(event) << " " << PRINTH(multiplicity) << " ";
+            HitElement::headerOn(os);
+        }
+    };
+    static_assert(std::is_pod<EventElement>::value, "Data::EventElement must be POD");
+
+    /* digitizerID under which the merged stream is written */
+    static constexpr const uint32_t mergedID = 0;
+
 static constexpr const size_t maxBufferSize = JUMBO_PAYLOAD - (UDP_HEADER + IP_HEADER);
 
 } // namespace Data
@@ -259,6 +385,12 @@ static inline std::ostream& operator<< (std::ostream& os, const Data::ListElemen
 { e.printOn(os); return os; }
 static inline std::ostream& operator<< (std::ostream& os, const Data::StdElement751& e)
 { e.printOn(os); return os; }
+static inline std::ostream& operator<< (std::ostream& os, const Data::RawElement& e)
+{ e.printOn(os); return os; }
+static inline std::ostream& operator<< (std::ostream& os, const Data::HitElement& e)
+{ e.printOn(os); return os; }
+static inline std::ostream& operator<< (std::ostream& os, const Data::EventElement& e)
+{ e.printOn(os); return os; }
 static inline std::ostream& operator<< (std::ostream& os, const Data::DPPQDCWaveformElement<Data::ListElement422>& e)
 { e.printOn(os); return os; }
 static inline std::ostream& operator<< (std::ostream& os, const Data::DPPQDCWaveformElement<Data::ListElement8222>& e)
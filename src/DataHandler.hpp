@@ -28,18 +28,65 @@
 #include "DataFormat.hpp"
 #include "DataWriter.hpp"
 #include "EventIterator.hpp"
+#include "Histograms.hpp"
 #include "container.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <vector>
 
 class DataHandler {
 public:
+    /* Updated by the decoding thread and read by the stats printer */
+    struct Stats {
+        std::atomic<uint64_t> handoffs{0};    // buffers passed to the DataWriter
+        std::atomic<uint64_t> allocations{0}; // buffers ever allocated
+        std::atomic<uint64_t> exhausted{0};   // times the pool had no free buffer
+        std::atomic<uint64_t> epochs{0};      // time-window slots started
+        std::atomic<uint64_t> late{0};        // events stored in an older slot than the newest
+        std::atomic<uint64_t> misordered{0};  // events earlier than one before them in the same slot
+    };
+    /* Buffers in a pool beyond the ones being filled */
+    static constexpr const size_t spareBuffers = 4;
+    /* Default number of time-window slots */
+    static constexpr const size_t defaultTimeSlots = 3;
+    /* A 32-bit time tag that went back by more than this rolled over */
+    static constexpr const uint32_t halfRange = 0x80000000u;
+    /* Upper bound of the channels in a group, for sizing histograms */
+    static constexpr const size_t channelsPerGroup = 8;
     template<typename E>
-    void initialize(DataWriter& dataWriter, uint32_t digitizerID, size_t groups, size_t samples, const uint32_t* maxJitter)
+    void initialize(DataWriter& dataWriter, uint32_t digitizerID, size_t groups, size_t samples, const uint32_t* maxJitter,
+                    size_t timeSlots = defaultTimeSlots, bool hugePages = false)
     {
-        instance.reset(new Implementation<E>(dataWriter,digitizerID,groups,samples,maxJitter));
+        dataWriter.addDigitizer(digitizerID, E::type(), samples);
+        instance.reset(new Implementation<E>(dataWriter,digitizerID,groups,samples,maxJitter,timeSlots,hugePages));
     }
     void flush() { instance->flush(); }
-    size_t operator()(DataBlockBaseIterator& it) { return instance->operator()(it); }
+    const Stats& stats() const { return instance->stats; }
+    /* Also pass buffers on that have held events for ms milliseconds, checked
+     * after every readout, so a slow trickle of events reaches the DataWriter
+     * in time. 0: only full buffers are passed on. */
+    void handoffInterval(unsigned ms) { instance->handoffInterval = std::chrono::milliseconds(ms); }
+    /* The check done after every readout, for when there was no data */
+    void handoffAged()
+    {
+        if (instance->handoffInterval.count() > 0) {
+            instance->handoffAged();
+        }
+    }
+    /* Fill online histograms from now on - not for raw data */
+    void histogram(unsigned bins, bool extras)
+    {
+        if (instance->channels > 0) {
+            instance->histograms.reset(new Histograms(instance->channels, bins, extras));
+        }
+    }
+    /* nullptr unless histogram() was called */
+    const Histograms* histograms() const { return instance->histograms.get(); }
+    size_t operator()(DPPQDCEventIterator& it) { return instance->operator()(it); }
+    size_t operator()(StdBLTEventIterator& it) { return instance->operator()(it); }
     static int64_t getTimeMsecs()
     {
         return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -48,9 +95,17 @@ public:
 private:
     struct Interface
     {
+        Stats stats;
+        size_t channels = 0; // that can be histogrammed
+        std::unique_ptr<Histograms> histograms;
+        std::chrono::steady_clock::duration handoffInterval{0};
         virtual ~Interface() = default;
-        virtual size_t operator()(DataBlockBaseIterator& it) = 0;
+        /* One entry per concrete iterator type, so the decode loop is
+         * instantiated for it and called without virtual dispatch */
+        virtual size_t operator()(DPPQDCEventIterator& it) = 0;
+        virtual size_t operator()(StdBLTEventIterator& it) = 0;
         virtual void flush() = 0;
+        virtual void handoffAged() = 0;
     };
     /* E is element type e.g. Data::ListElementxxx
      * C is containertype i.e. jadaq::vector, jadaq::set, jadaq::buffer
@@ -63,115 +118,307 @@ private:
         DataWriter& dataWriter;
         uint32_t digitizerID;
         const uint32_t* maxJitter;
+        jadaq::buffer_pool<E> pool;
 
-    struct Buffer {
+    /* Events between two resets of the local time, i.e. an epoch */
+    struct Slot {
       size_t groups;
-      jadaq::buffer<E> *buffer;
-      uint32_t *maxLocalTime; // Array containing MaxLocalTime from the previous
-                              // insertion needed to detect reset
+      jadaq::buffer<E> *buffer = nullptr;
+      uint64_t *maxTime = nullptr; // Per group maximum local time in this epoch,
+                                   // with rollovers in the upper 32 bits,
+                                   // needed to detect reset
       uint64_t globalTimeStamp = 0;
+      uint16_t rollover = 0; // of the events in buffer
+      std::chrono::steady_clock::time_point filled; // first event in buffer
       void clear() {
         buffer->clear();
         for (size_t i = 0; i < groups; ++i) {
-          maxLocalTime[i] = 0;
+          maxTime[i] = 0;
         }
         globalTimeStamp = 0;
+        rollover = 0;
       }
-      Buffer(size_t numGroups) : groups(numGroups) {}
+      Slot(size_t numGroups) : groups(numGroups) {}
 
-      void malloc(DataWriter &dataWriter, size_t samples) {
-        buffer = new jadaq::buffer<E>(Data::maxBufferSize, E::size(samples),
-                                        sizeof(Data::Header));
-        maxLocalTime = new uint32_t[groups];
+      void malloc(jadaq::buffer<E> *b) {
+        buffer = b;
+        maxTime = new uint64_t[groups];
         clear();
       }
       void free() {
-        delete buffer;
-        delete[] maxLocalTime;
+        buffer->release();
+        delete[] maxTime;
       }
+    };
+    /* Ring of time-window slots. Epoch e lives in slots[e % slots.size()],
+     * the epochs from tail to head are in use. */
+    std::vector<Slot> slots;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+
+    Slot &slot(uint64_t epoch) { return slots[epoch % slots.size()]; }
 
-    } previous, current, next;
+    jadaq::buffer<E> *acquire() {
+      jadaq::buffer<E> *b = pool.acquire();
+      if (b == nullptr) {
+        stats.exhausted += 1;
+        stats.allocations += 1;
+        b = pool.allocate();
+      }
+      return b;
+    }
 
-    void inline store(Buffer &buffer, typename E::EventType &event,
-                      uint16_t group) {
-      buffer.maxLocalTime[group] = event.timeTag();
-      try {
-        buffer.buffer->emplace_back(event, group);
-      } catch (std::length_error &) {
-        dataWriter(buffer.buffer, digitizerID, buffer.globalTimeStamp);
-        buffer.buffer->clear();
-        buffer.buffer->emplace_back(event, group);
+    /* Pass the buffer on to the DataWriter and continue in a recycled one */
+    void handoff(Slot &slot) {
+      jadaq::buffer<E> *full = slot.buffer;
+      reinterpret_cast<Data::Header *>(full->data())->rollover = slot.rollover;
+      slot.buffer = acquire();
+      dataWriter(full, digitizerID, slot.globalTimeStamp);
+      pool.release(full); // the DataWriter is done with it
+      stats.handoffs += 1;
+    }
+
+    /* Write out and recycle the oldest slot */
+    void retire() {
+      Slot &oldest = slot(tail);
+      if (!oldest.buffer->empty()) {
+        handoff(oldest);
+      }
+      oldest.clear();
+      tail += 1;
+    }
+
+    /* Start a new epoch, the oldest one ages out if the ring is full */
+    void advance() {
+      if (head - tail + 1 == slots.size()) {
+        retire();
+      }
+      head += 1;
+      slot(head).globalTimeStamp = DataHandler::getTimeMsecs();
+      stats.epochs += 1;
+    }
+
+    /* Find the epoch of an event. Starting from the newest epoch, look for the
+     * latest one holding events from the group. The event belongs there if
+     * its local time continues from them, possibly across a rollover of the
+     * 32-bit time tag. Otherwise the local time was reset and it belongs to
+     * the epoch after, which may have to be started. rollover is set to the
+     * number of rollovers before the event within its epoch. */
+    uint64_t epochOf(uint16_t group, uint32_t time, uint64_t &rollover) {
+      for (uint64_t epoch = head;; --epoch) {
+        uint64_t maxTime = slot(epoch).maxTime[group];
+        if (maxTime != 0) {
+          uint32_t last = (uint32_t)maxTime;
+          rollover = maxTime >> 32;
+          if (last < (uint64_t)time + maxJitter[group]) {
+            if (time > last && time - last > halfRange && rollover > 0) {
+              rollover -= 1; // from before the latest rollover
+            }
+            return epoch;
+          }
+          if (last - time > halfRange) {
+            rollover += 1;
+            return epoch;
+          }
+          if (epoch == head) {
+            advance();
+          }
+          rollover = 0;
+          return epoch + 1;
+        }
+        if (epoch == tail) {
+          rollover = 0;
+          return head; // first event from this group
+        }
+      }
+    }
+
+    /* Capacity is checked up front, so emplace_back never throws. A data
+     * package only holds events with the same number of rollovers. */
+    void inline store(Slot &slot, typename E::EventType &event,
+                      uint16_t group, uint64_t rollover) {
+      uint64_t &maxTime = slot.maxTime[group];
+      uint64_t time = (rollover << 32) | event.timeTag();
+      if (time < maxTime) {
+        stats.misordered += 1;
+      } else {
+        maxTime = time;
+      }
+      if (slot.buffer->full() ||
+          (slot.rollover != (uint16_t)rollover && !slot.buffer->empty())) {
+        handoff(slot);
+      }
+      slot.rollover = (uint16_t)rollover;
+      if (slot.buffer->empty() && handoffInterval.count() > 0) {
+        slot.filled = std::chrono::steady_clock::now();
+      }
+      slot.buffer->emplace_back(event, group);
+      if (histograms) {
+        histograms->fill(slot.buffer->back());
       }
     }
 
   public:
     Implementation(DataWriter &dw, uint32_t digID, size_t groups,
-                   size_t samples, const uint32_t *jitter)
+                   size_t samples, const uint32_t *jitter, size_t timeSlots,
+                   bool hugePages)
         : dataWriter(dw), digitizerID(digID), maxJitter(jitter),
-          previous(groups), current(groups), next(groups) {
-      previous.malloc(dataWriter, samples);
-      current.malloc(dataWriter, samples);
-      next.malloc(dataWriter, samples);
-      previous.globalTimeStamp = DataHandler::getTimeMsecs();
-      current.globalTimeStamp = DataHandler::getTimeMsecs();
+          pool(dw.bufferSize(), E::size(samples), sizeof(Data::Header), hugePages),
+          slots(std::max<size_t>(timeSlots, 2), Slot(groups)) {
+      channels = groups * channelsPerGroup;
+      pool.reserve(slots.size() + spareBuffers);
+      stats.allocations = slots.size() + spareBuffers;
+      for (Slot &slot : slots) {
+        slot.malloc(pool.acquire());
+      }
+      slot(head).globalTimeStamp = DataHandler::getTimeMsecs();
     }
     ~Implementation() {
       flush();
-      previous.free();
-      current.free();
-      next.free();
+      for (Slot &slot : slots) {
+        slot.free();
+      }
     }
 
-      size_t operator()(DataBlockBaseIterator& eventIterator)
+      size_t operator()(DPPQDCEventIterator& eventIterator) override
+        { return decode(eventIterator); }
+      size_t operator()(StdBLTEventIterator& eventIterator) override
+        { return decode(eventIterator); }
+
+      template <typename I>
+      size_t decode(I& eventIterator)
         {
             size_t events = 0;
             for (;eventIterator != eventIterator.end(); ++eventIterator)
             {
                 events += 1;
-                typename E::EventType event = eventIterator.event<typename E::EventType>();
+                typename E::EventType event = eventIterator.template event<typename E::EventType>();
                 uint16_t group = eventIterator.group();
                 XTRACE(DATAH, DEB, "Digitizer: %d_%d, time: 0x%04x", digitizerID>>16, digitizerID & 0xFFFF, event.timeTag());
-                if (current.maxLocalTime[group] < event.timeTag() + maxJitter[group]) {
-                  if (current.maxLocalTime[group] > 0 ||
-                      previous.maxLocalTime[group] == 0 ||
-                      previous.maxLocalTime[group] >=
-                      event.timeTag() + maxJitter[group]) {
-                    store(current, event, group);
-                  } else {
-                    store(previous, event, group);
-                  }
-                } else {
-                  if (next.globalTimeStamp == 0) {
-                    next.globalTimeStamp = DataHandler::getTimeMsecs();
-                  }
-                  store(next, event, group);
-        }
+                uint64_t rollover;
+                uint64_t epoch = epochOf(group, event.timeTag(), rollover);
+                if (epoch != head) {
+                  stats.late += 1;
+                }
+                store(slot(epoch), event, group, rollover);
+            }
+      XTRACE(DATAH, DEB, "events parsed %d", events);
+      if (handoffInterval.count() > 0) {
+        handoffAged();
       }
-      if (!next.buffer->empty()) {
-        if (previous.buffer->size() > 0) {
-          dataWriter(previous.buffer, digitizerID, previous.globalTimeStamp);
+      return events;
+    }
+
+    /* Pass on the buffers holding events for longer than handoffInterval.
+     * The epochs stay open. */
+    void handoffAged() override {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      for (uint64_t epoch = tail; epoch <= head; ++epoch) {
+        Slot &s = slot(epoch);
+        if (!s.buffer->empty() && now - s.filled >= handoffInterval) {
+          handoff(s);
         }
-        previous.clear();
-        std::swap(current, previous);
-        std::swap(next, current);
       }
-      XTRACE(DATAH, DEB, "events parsed %d", events);
-      return events;
     }
 
+    /* Write out all epochs, oldest first, and continue in the newest */
     void flush() {
-      if (previous.buffer->size() > 0) {
-        dataWriter(previous.buffer, digitizerID, previous.globalTimeStamp);
-        previous.clear();
+      while (tail != head) {
+        retire();
       }
-      if (current.buffer->size() > 0) {
-        dataWriter(current.buffer, digitizerID, current.globalTimeStamp);
-        current.clear();
+      Slot &newest = slot(head);
+      if (!newest.buffer->empty()) {
+        handoff(newest);
       }
-      assert(next.buffer->size() == 0);
     }
   };
   std::unique_ptr<Interface> instance;
 };
 
+/* Raw pass-through: the readout buffer is written verbatim instead of being
+ * decoded. Aggregates - board aggregates for DPP firmware and events for the
+ * standard firmware, both starting with a word holding 0xA and the size in
+ * words - are kept whole within one data package when they fit. Larger
+ * aggregates continue in the following package(s). */
+template <>
+class DataHandler::Implementation<Data::RawElement> : public DataHandler::Interface
+{
+private:
+    DataWriter& dataWriter;
+    uint32_t digitizerID;
+    jadaq::buffer_pool<Data::RawElement> pool;
+    jadaq::buffer<Data::RawElement> *buffer;
+    uint64_t globalTimeStamp = 0;
+
+    size_t space() const { return buffer->capacity() - buffer->size(); }
+
+    /* Pass the buffer on to the DataWriter and continue in a recycled one */
+    void write() {
+        if (!buffer->empty()) {
+            jadaq::buffer<Data::RawElement> *full = buffer;
+            buffer = pool.acquire();
+            if (buffer == nullptr) {
+                stats.exhausted += 1;
+                stats.allocations += 1;
+                buffer = pool.allocate();
+            }
+            dataWriter(full, digitizerID, globalTimeStamp);
+            pool.release(full); // the DataWriter is done with it
+            stats.handoffs += 1;
+        }
+    }
+
+    /* Returns the number of aggregates passed on */
+    size_t passThrough(const caen::ReadoutBuffer &block) {
+        const uint32_t *ptr = (const uint32_t *)block.begin();
+        const uint32_t *end = (const uint32_t *)block.end();
+        size_t aggregates = 0;
+        globalTimeStamp = DataHandler::getTimeMsecs();
+        while (ptr < end) {
+            size_t words = std::min((size_t)(ptr[0] & 0x0fffffffu), (size_t)(end - ptr));
+            if (words == 0) {
+                words = end - ptr; // not an aggregate - pass the rest on as is
+            }
+            aggregates += 1;
+            if (words > space()) {
+                write();
+            }
+            while (words > 0) {
+                size_t n = std::min(words, space());
+                buffer->append(ptr, n);
+                ptr += n;
+                words -= n;
+                if (space() == 0) {
+                    write();
+                }
+            }
+        }
+        write(); // one readout never shares a package with the next
+        return aggregates;
+    }
+
+public:
+    Implementation(DataWriter &dw, uint32_t digID, size_t, size_t, const uint32_t *, size_t,
+                   bool hugePages)
+        : dataWriter(dw), digitizerID(digID),
+          pool(dw.bufferSize(), Data::RawElement::size(), sizeof(Data::Header), hugePages) {
+        pool.reserve(1 + spareBuffers);
+        stats.allocations = 1 + spareBuffers;
+        buffer = pool.acquire();
+    }
+    ~Implementation() {
+        flush();
+        buffer->release();
+    }
+
+    size_t operator()(DPPQDCEventIterator& eventIterator) override
+    { return passThrough(eventIterator.block()); }
+    size_t operator()(StdBLTEventIterator& eventIterator) override
+    { return passThrough(eventIterator.block()); }
+
+    void flush() override { write(); }
+    /* Every readout is written as a whole already */
+    void handoffAged() override {}
+};
+
 #endif // JADAQ_DATAHANDLER_HPP
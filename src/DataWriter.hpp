@@ -37,14 +37,21 @@ public:
     return *this;
   }
 
-  void addDigitizer(uint32_t digitizerID) {
-    instance->addDigitizer(digitizerID);
+  /* The digitizer delivers elements of type, with samples samples in each
+   * waveform, before any data is written */
+  void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) {
+    instance->addDigitizer(digitizerID, type, samples);
   }
 
   void split(const std::string& id) {
     instance->split(id);
   }
 
+  /* Size in bytes, including the header, of the buffers the DataWriter wants */
+  size_t bufferSize() const {
+    return instance->bufferSize();
+  }
+
   template <typename E>
   void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
                   uint64_t globalTimeStamp) {
@@ -56,23 +63,29 @@ private:
     struct Concept
     {
         virtual ~Concept() = default;
-        virtual void addDigitizer(uint32_t digitizerID) = 0;
+        virtual void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) = 0;
         virtual void split(const std::string& id) = 0;
+        virtual size_t bufferSize() const = 0;
         virtual void operator()(const jadaq::buffer<Data::ListElement422>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
         virtual void operator()(const jadaq::buffer<Data::ListElement8222>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
         virtual void operator()(const jadaq::buffer<Data::StdElement751>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
         virtual void operator()(const jadaq::buffer<Data::DPPQDCWaveformElement<Data::ListElement422> >* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
         virtual void operator()(const jadaq::buffer<Data::DPPQDCWaveformElement<Data::ListElement8222> >* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
+        virtual void operator()(const jadaq::buffer<Data::RawElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
+        virtual void operator()(const jadaq::buffer<Data::HitElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
+        virtual void operator()(const jadaq::buffer<Data::EventElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) = 0;
     };
     template <typename DW>
     struct Model : Concept
     {
         explicit Model(DW* value) : val(value) {}
         ~Model() { delete val; }
-        void addDigitizer(uint32_t digitizerID) override
-        { val->addDigitizer(digitizerID); }
+        void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) override
+        { val->addDigitizer(digitizerID, type, samples); }
         void split(const std::string& id) override
         { return val->split(id); }
+        size_t bufferSize() const override
+        { return val->bufferSize(); }
         void operator()(const jadaq::buffer<Data::ListElement422>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
         { val->operator()(buffer,digitizerID,globalTimeStamp); }
         void operator()(const jadaq::buffer<Data::ListElement8222>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
@@ -83,6 +96,12 @@ private:
         { val->operator()(buffer,digitizerID,globalTimeStamp); }
         void operator()(const jadaq::buffer<Data::DPPQDCWaveformElement<Data::ListElement8222> >* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
         { val->operator()(buffer,digitizerID,globalTimeStamp); }
+        void operator()(const jadaq::buffer<Data::RawElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
+        { val->operator()(buffer,digitizerID,globalTimeStamp); }
+        void operator()(const jadaq::buffer<Data::HitElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
+        { val->operator()(buffer,digitizerID,globalTimeStamp); }
+        void operator()(const jadaq::buffer<Data::EventElement>* buffer, uint32_t digitizerID, uint64_t globalTimeStamp) final
+        { val->operator()(buffer,digitizerID,globalTimeStamp); }
         DW* val;
     };
 
@@ -92,8 +111,9 @@ private:
 class DataWriterNull {
 public:
   DataWriterNull() = default;
-  void addDigitizer(uint32_t) {}
+  void addDigitizer(uint32_t, Data::ElementType, size_t) {}
   void split(const std::string&) { }
+  size_t bufferSize() const { return Data::maxBufferSize; }
   template <typename E>
   void operator()(const jadaq::buffer<E> *, uint32_t, uint64_t) const {}
 };
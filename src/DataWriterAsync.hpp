@@ -0,0 +1,267 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Pass buffers on to another DataWriter from a thread of its own, so a slow
+ * sink does not stall the readout. Buffers are queued by reference in a
+ * bounded lock-free queue. What happens when it is full is set by the policy:
+ * Block waits for room, Drop throws the buffer away and Spill puts it in an
+ * unbounded overflow list.
+ *
+ */
+
+#ifndef JADAQ_DATAWRITERASYNC_HPP
+#define JADAQ_DATAWRITERASYNC_HPP
+
+#include "DataFormat.hpp"
+#include "DataWriter.hpp"
+#include "container.hpp"
+#include "ring.hpp"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DataWriterAsync {
+public:
+  enum Policy { Block, Drop, Spill };
+  static Policy policy(const std::string &name) {
+    if (name == "block") {
+      return Block;
+    } else if (name == "drop") {
+      return Drop;
+    } else if (name == "spill") {
+      return Spill;
+    }
+    throw std::invalid_argument("Unknown queue policy: \"" + name + "\"");
+  }
+
+  struct Stats {
+    std::atomic<uint64_t> queued{0};  // buffers passed to the writer
+    std::atomic<uint64_t> written{0}; // buffers passed on to the sink
+    std::atomic<uint64_t> blocked{0}; // buffers that waited for room
+    std::atomic<uint64_t> dropped{0}; // buffers thrown away
+    std::atomic<uint64_t> spilled{0}; // buffers put in the overflow list
+    std::atomic<uint64_t> depth{0};   // buffers waiting to be written
+    std::atomic<uint64_t> highWater{0}; // largest depth seen
+  };
+
+private:
+  struct Item {
+    void (*write)(DataWriter &, const void *, uint32_t, uint64_t);
+    const void *buffer;
+    uint32_t digitizerID;
+    uint64_t globalTimeStamp;
+    std::atomic<bool> *done; // set once written, for items the caller waits for
+  };
+
+  /* One instance per element type, so items need no type tag. Buffers
+   * outside a pool are not ours to release. */
+  template <typename E, bool pooled>
+  static void writeAs(DataWriter &sink, const void *b, uint32_t digitizerID,
+                      uint64_t globalTimeStamp) {
+    const jadaq::buffer<E> *buffer = static_cast<const jadaq::buffer<E> *>(b);
+    sink(buffer, digitizerID, globalTimeStamp);
+    if (pooled) {
+      buffer->release();
+    }
+  }
+
+  DataWriter sink;
+  size_t const bufferSize_; // asked before the writer thread runs
+  Policy const policy_;
+  jadaq::mpsc_ring<Item> queue;
+  std::vector<Item> overflow;
+  std::mutex overflowMutex;
+  std::atomic<size_t> overflowSize{0};
+  std::atomic<bool> stop{false};
+  Stats stats_;
+  std::thread thread;
+
+  void updateDepth() {
+    uint64_t depth = queue.size() + overflowSize.load();
+    stats_.depth = depth;
+    uint64_t high = stats_.highWater.load();
+    while (depth > high && !stats_.highWater.compare_exchange_weak(high, depth)) {
+    }
+  }
+
+  static void splitAs(DataWriter &sink, const void *id, uint32_t, uint64_t) {
+    sink.split(*static_cast<const std::string *>(id));
+  }
+
+  struct Added {
+    Data::ElementType type;
+    size_t samples;
+    std::exception_ptr error; // thrown by the sink, for the caller
+  };
+  static void addDigitizerAs(DataWriter &sink, const void *a, uint32_t digitizerID, uint64_t) {
+    Added &added = *static_cast<Added *>(const_cast<void *>(a));
+    try {
+      sink.addDigitizer(digitizerID, added.type, added.samples);
+    } catch (...) {
+      added.error = std::current_exception();
+    }
+  }
+
+  void write(const Item &item) {
+    item.write(sink, item.buffer, item.digitizerID, item.globalTimeStamp);
+    stats_.written += 1;
+    if (item.done != nullptr) {
+      item.done->store(true, std::memory_order_release);
+    }
+  }
+
+  void run() {
+    std::vector<Item> spilled;
+    while (true) {
+      Item item;
+      if (queue.pop(item)) {
+        write(item);
+      } else if (overflowSize.load() > 0) {
+        // Everything spilled came after what was in the queue
+        {
+          std::lock_guard<std::mutex> lock(overflowMutex);
+          spilled.swap(overflow);
+          overflowSize = 0;
+        }
+        for (const Item &i : spilled) {
+          write(i);
+        }
+        spilled.clear();
+      } else if (stop) {
+        return;
+      } else {
+        stats_.depth = 0;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+  }
+
+  static void wait(const std::atomic<bool> &done) {
+    while (!done.load(std::memory_order_acquire)) {
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+  }
+
+  /* Queue an item by the policy, returns false if it was dropped. Items
+   * waited for are never dropped. */
+  bool enqueue(const Item &item) {
+    stats_.queued += 1;
+    // Once spilling, keep spilling until the writer caught up, to keep order
+    if (policy_ == Spill && overflowSize.load() > 0) {
+      std::lock_guard<std::mutex> lock(overflowMutex);
+      overflow.push_back(item);
+      overflowSize += 1;
+      stats_.spilled += 1;
+      updateDepth();
+      return true;
+    }
+    if (!queue.push(item)) {
+      switch (policy_) {
+      case Block:
+        stats_.blocked += 1;
+        while (!queue.push(item)) {
+          std::this_thread::sleep_for(std::chrono::microseconds(10));
+        }
+        break;
+      case Drop:
+        if (item.done == nullptr) {
+          stats_.dropped += 1;
+          return false;
+        }
+        // the caller waits for it, so it is not dropped
+        while (!queue.push(item)) {
+          std::this_thread::sleep_for(std::chrono::microseconds(10));
+        }
+        break;
+      case Spill: {
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflow.push_back(item);
+        overflowSize += 1;
+        stats_.spilled += 1;
+        break;
+      }
+      }
+    }
+    updateDepth();
+    return true;
+  }
+
+public:
+  /* depth: number of buffers the queue holds, rounded up to a power of two */
+  DataWriterAsync(DataWriter &&sink_, size_t depth, Policy policy)
+      : sink(std::move(sink_)), bufferSize_(sink.bufferSize()), policy_(policy), queue(depth) {
+    thread = std::thread(&DataWriterAsync::run, this);
+  }
+
+  ~DataWriterAsync() {
+    stop = true;
+    thread.join();
+  }
+
+  /* Digitizers are set up in parallel, so the writer thread adds them like
+   * it splits, and only that thread calls the sink. What the sink throws is
+   * thrown here. */
+  void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) {
+    Added added{type, samples, nullptr};
+    std::atomic<bool> done{false};
+    enqueue(Item{&addDigitizerAs, &added, digitizerID, 0, &done});
+    wait(done);
+    if (added.error) {
+      std::rethrow_exception(added.error);
+    }
+  }
+
+  /* Everything queued so far goes to the current file. The writer thread
+   * splits, after writing what was queued before. */
+  void split(const std::string &id) {
+    std::atomic<bool> done{false};
+    enqueue(Item{&splitAs, &id, 0, 0, &done});
+    wait(done);
+  }
+
+  size_t bufferSize() const { return bufferSize_; }
+
+  const Stats &stats() const { return stats_; }
+
+  template <typename E>
+  void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
+                  uint64_t globalTimeStamp) {
+    if (!buffer->retain()) {
+      // Not pooled, so it can not outlive this call. It is still written by
+      // the writer thread, as the sink is not safe to call from two threads,
+      // and this call waits for that.
+      std::atomic<bool> done{false};
+      enqueue(Item{&writeAs<E, false>, buffer, digitizerID, globalTimeStamp, &done});
+      wait(done);
+      return;
+    }
+    if (!enqueue(Item{&writeAs<E, true>, buffer, digitizerID, globalTimeStamp, nullptr})) {
+      buffer->release();
+    }
+  }
+};
+
+#endif // JADAQ_DATAWRITERASYNC_HPP
@@ -0,0 +1,100 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Pass every buffer on to several DataWriters, e.g. a file and the network.
+ * Each sink is written from a queue and thread of its own, see
+ * DataWriterAsync, so one sink falling behind does not hold up the others.
+ * The buffers are shared between the queues by reference count, not copied.
+ *
+ */
+
+#ifndef JADAQ_DATAWRITERFANOUT_HPP
+#define JADAQ_DATAWRITERFANOUT_HPP
+
+#include "DataWriter.hpp"
+#include "DataWriterAsync.hpp"
+#include "container.hpp"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DataWriterFanout {
+private:
+  struct Sink {
+    std::string name;
+    std::unique_ptr<DataWriterAsync> writer;
+  };
+  std::vector<Sink> sinks;
+  size_t depth;
+  DataWriterAsync::Policy policy;
+
+public:
+  static constexpr const size_t defaultDepth = 64; // buffers per sink
+
+  /* depth and policy apply to the queue of every sink */
+  DataWriterFanout(size_t depth_, DataWriterAsync::Policy policy_)
+      : depth(depth_), policy(policy_) {}
+
+  /* Sinks must all be added before the first digitizer */
+  void add(const std::string &name, DataWriter &&sink) {
+    sinks.push_back(Sink{name, std::unique_ptr<DataWriterAsync>(
+                                   new DataWriterAsync(std::move(sink), depth, policy))});
+  }
+
+  size_t size() const { return sinks.size(); }
+  const std::string &name(size_t i) const { return sinks[i].name; }
+  const DataWriterAsync::Stats &stats(size_t i) const {
+    return sinks[i].writer->stats();
+  }
+
+  void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) {
+    for (Sink &sink : sinks) {
+      sink.writer->addDigitizer(digitizerID, type, samples);
+    }
+  }
+
+  void split(const std::string &id) {
+    for (Sink &sink : sinks) {
+      sink.writer->split(id);
+    }
+  }
+
+  /* The buffers are shared, so they are sized for the sink that wants the
+   * largest, e.g. HDF5. DataWriterNetwork sends them as several datagrams. */
+  size_t bufferSize() const {
+    size_t size = 0;
+    for (const Sink &sink : sinks) {
+      size = std::max(size, sink.writer->bufferSize());
+    }
+    return size;
+  }
+
+  template <typename E>
+  void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
+                  uint64_t globalTimeStamp) {
+    for (Sink &sink : sinks) {
+      (*sink.writer)(buffer, digitizerID, globalTimeStamp);
+    }
+  }
+};
+
+#endif // JADAQ_DATAWRITERFANOUT_HPP
@@ -26,46 +26,277 @@
 #define JADAQ_DATAHANDLERHDF5_HPP
 
 #include "DataFormat.hpp"
+#include "columns.hpp"
 #include "container.hpp"
+#include "h5append.hpp"
+#include "h5direct.hpp"
+#include "parallel.hpp"
 #include <H5Cpp.h>
 #include <H5PacketTable.h>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 class DataWriterHDF5 {
+public:
+  /* Tables: one table per globalTimeStamp and digitizer
+   * Appended: one dataset per digitizer, and an index of the time stamps
+   * Columns: as Appended, with list mode data in one dataset per field */
+  enum Layout { Tables, Appended, Columns };
+  static Layout layout(const std::string &name) {
+    if (name == "tables") {
+      return Tables;
+    } else if (name == "appended") {
+      return Appended;
+    } else if (name == "columns") {
+      return Columns;
+    }
+    throw std::invalid_argument("Unknown HDF5 layout: \"" + name + "\"");
+  }
+
+  /* Row of the index of the Appended and Columns layouts: the count rows from first on
+   * were written with globalTimeStamp and rollover */
+  struct __attribute__((__packed__)) IndexEntry {
+    uint64_t globalTimeStamp;
+    uint64_t first;
+    uint32_t count;
+    uint16_t rollover;
+    static H5::CompType h5type() {
+      H5::CompType datatype(sizeof(IndexEntry));
+      datatype.insertMember("globalTimeStamp", HOFFSET(IndexEntry, globalTimeStamp), H5::PredType::NATIVE_UINT64);
+      datatype.insertMember("first", HOFFSET(IndexEntry, first), H5::PredType::NATIVE_UINT64);
+      datatype.insertMember("count", HOFFSET(IndexEntry, count), H5::PredType::NATIVE_UINT32);
+      datatype.insertMember("rollover", HOFFSET(IndexEntry, rollover), H5::PredType::NATIVE_UINT16);
+      return datatype;
+    }
+  };
+
+  /* Chunks of the Appended and Columns layouts fit in the default chunk cache */
+  static constexpr const size_t chunkBytes = 512 << 10;
+  static constexpr const size_t indexChunkRows = 1024;
+  /* Chunk cache of a dataset unless set in Options - the HDF5 default */
+  static constexpr const size_t defaultCacheBytes = 1 << 20;
+
+  /* Kind of element for storage settings: list, waveform, standard, raw,
+   * hit or event */
+  static std::string kind(uint16_t elementType) {
+    if (elementType & Data::WaveformBase) {
+      return "waveform";
+    }
+    switch (elementType) {
+    case Data::List422:
+    case Data::List8222:
+      return "list";
+    case Data::Standard:
+      return "standard";
+    case Data::Raw:
+      return "raw";
+    case Data::Hit:
+      return "hit";
+    case Data::Event:
+      return "event";
+    default:
+      return "";
+    }
+  }
+
+  struct Options {
+    Layout layout = Tables;
+    size_t cacheBytes = 0; // chunk cache of each dataset, 0: library default
+    /* Threads filtering the chunks of the Appended and Columns layouts,
+     * which are then written with H5Dwrite_chunk. 0: the library filters
+     * them. */
+    size_t workers = 0;
+    /* Single writer, multiple readers: readers can follow the file of the
+     * Appended and Columns layouts while it is written. Data is flushed to
+     * the file every flushInterval milliseconds. */
+    bool swmr = false;
+    unsigned flushInterval = 1000;
+    std::map<std::string, jadaq::h5storage> storage; // by kind, "" for all
+
+    /* spec is [<kind>=]<value>, returns the storage settings of the kind and
+     * leaves the value in spec */
+    jadaq::h5storage &storageFor(std::string &spec) {
+      std::string kind;
+      size_t equal = spec.find('=');
+      if (equal != std::string::npos) {
+        kind = spec.substr(0, equal);
+        spec = spec.substr(equal + 1);
+        if (kind != "list" && kind != "waveform" && kind != "standard" &&
+            kind != "raw" && kind != "hit" && kind != "event") {
+          throw std::invalid_argument("Unknown element kind: \"" + kind + "\"");
+        }
+      }
+      return storage[kind];
+    }
+    jadaq::h5storage storageOf(uint16_t elementType) const {
+      jadaq::h5storage settings;
+      auto all = storage.find("");
+      if (all != storage.end()) {
+        settings.merge(all->second);
+      }
+      auto own = storage.find(kind(elementType));
+      if (own != storage.end()) {
+        settings.merge(own->second);
+      }
+      return settings;
+    }
+  };
+
 private:
+  /* Dataset of the Appended and Columns layouts, filtered by the library or,
+   * with workers, written directly in chunks */
+  struct Dataset {
+    jadaq::h5append *library = nullptr;
+    jadaq::h5direct *direct = nullptr;
+    void append(const void *data, hsize_t n) {
+      if (direct) {
+        direct->append(data, n);
+      } else {
+        library->append(data, n);
+      }
+    }
+    hsize_t size() const { return direct ? direct->size() : library->size(); }
+    /* Rows written to the file, short of size() while direct chunks are
+     * being collected or filtered */
+    hsize_t visible() const { return direct ? direct->visible() : library->size(); }
+    void flush() {
+      if (direct) {
+        direct->flush();
+      } else {
+        library->flush();
+      }
+    }
+    void close() {
+      delete library;
+      delete direct; // waits for its chunks
+      library = nullptr;
+      direct = nullptr;
+    }
+  };
+
   struct DigitizerInfo {
     FL_PacketTable *previous = nullptr;
     FL_PacketTable *current = nullptr;
     H5::Group *group = nullptr;
     uint16_t format = Data::ElementType::None;
     uint64_t currentTimeStamp = 0;
-    FL_PacketTable *&getTable(uint64_t timeStamp) {
-      if (timeStamp == currentTimeStamp)
+    uint16_t currentRollover = 0;
+    /* Appended and Columns layouts */
+    std::vector<Dataset> datasets; // data, or one per column
+    jadaq::h5append *index = nullptr;
+    IndexEntry entry;   // the index row being added to
+    bool entryOpen = false;
+    std::deque<IndexEntry> closed; // index rows waiting for their data
+    hsize_t rows() const { return datasets.front().size(); }
+    hsize_t visibleRows() const {
+      hsize_t rows = datasets.front().visible();
+      for (const Dataset &dataset : datasets) {
+        rows = std::min(rows, dataset.visible());
+      }
+      return rows;
+    }
+    /* Add count rows from the data written last to the index */
+    void addToIndex(uint64_t timeStamp, uint16_t rollover, uint32_t count) {
+      if (entryOpen && (entry.globalTimeStamp != timeStamp || entry.rollover != rollover ||
+                        entry.count > UINT32_MAX - count)) {
+        closeEntry();
+        writeIndex(false);
+      }
+      if (!entryOpen) {
+        entry.globalTimeStamp = timeStamp;
+        entry.first = rows() - count;
+        entry.count = 0;
+        entry.rollover = rollover;
+        entryOpen = true;
+      }
+      entry.count += count;
+    }
+    void closeEntry() {
+      if (entryOpen) {
+        closed.push_back(entry);
+        entryOpen = false;
+      }
+    }
+    /* Index rows are written once all their data is, so the index never
+     * runs ahead of the data. all: the data is complete. */
+    void writeIndex(bool all) {
+      hsize_t rows = all ? 0 : visibleRows();
+      while (!closed.empty() && (all || closed.front().first + closed.front().count <= rows)) {
+        index->append(&closed.front(), 1);
+        closed.pop_front();
+      }
+    }
+    /* The data before the index, so the index does not run ahead of it */
+    void flush() {
+      if (index == nullptr) {
+        return;
+      }
+      closeEntry();
+      for (Dataset &dataset : datasets) {
+        dataset.flush();
+      }
+      writeIndex(false);
+      index->flush();
+    }
+    /* A table holds data with one time stamp and one rollover count */
+    FL_PacketTable *&getTable(uint64_t timeStamp, uint16_t rollover) {
+      if (timeStamp == currentTimeStamp && rollover == currentRollover)
         return current;
-      else if (timeStamp < currentTimeStamp)
+      else if (timeStamp < currentTimeStamp ||
+               (timeStamp == currentTimeStamp && rollover < currentRollover))
         return previous;
       else {
         if (previous)
           delete (previous);
         previous = current;
         currentTimeStamp = timeStamp;
+        currentRollover = rollover;
         current = nullptr;
         return current;
       }
     }
+    /* Tables past the first rollover of the time tag are named
+     * <timestamp>_<rollover> */
+    static std::string tableName(uint64_t timeStamp, uint16_t rollover) {
+      std::string name = std::to_string(timeStamp);
+      if (rollover > 0)
+        name += "_" + std::to_string(rollover);
+      return name;
+    }
   };
   const std::string &pathname;
   const std::string &basename;
+  Options const options;
 
   H5::H5File *file = nullptr;
   H5::Group *root = nullptr;
   std::mutex mutex;
+  std::unique_ptr<jadaq::task_pool> workers;
   std::map<uint32_t, DigitizerInfo> digitizerInfo;
+  /* Added digitizers, which get their datasets in every file */
+  struct Source {
+    Data::ElementType type;
+    size_t samples;
+  };
+  std::map<uint32_t, Source> digitizers;
+  /* SWMR mode */
+  bool swmr = false; // for the current file, off once starting it failed
+  bool swmrStarted = false;
+  bool stopFlushing = false;
+  std::condition_variable flushTimer;
+  std::thread flusher;
 
   DigitizerInfo &getDigitizerInfo(uint32_t digitizerID) {
     auto itr = digitizerInfo.find(digitizerID);
@@ -100,9 +331,21 @@ private:
     std::string filename = pathname + basename + id + ".h5";
     try {
       assert(file == nullptr);
-      file = new H5::H5File(filename, H5F_ACC_TRUNC);
+      H5::FileAccPropList access;
+      if (options.cacheBytes > 0) {
+        // Chunks are written once, so evict fully written ones first
+        access.setCache(0, jadaq::h5append::cacheSlots, options.cacheBytes, 1.0);
+      }
+      if (options.swmr) {
+        access.setLibverBounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+      }
+      file = new H5::H5File(filename, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, access);
+      swmr = options.swmr;
       assert(root == nullptr);
       root = new H5::Group(file->openGroup("/"));
+      for (auto &itr : digitizers) {
+        addDatasets(itr.first, itr.second);
+      }
     } catch (H5::Exception &e) {
       std::cerr << "ERROR: could not open/create HDF5-file \"" << filename
                 << "\":" << e.getDetailMsg() << std::endl;
@@ -110,9 +353,60 @@ private:
     }
   }
 
+  /* No objects can be created in SWMR mode. Every added digitizer gets its
+   * datasets up front, so it is started with the first data. */
+  void startSwmr() {
+    for (auto &itr : digitizers) {
+      auto info = digitizerInfo.find(itr.first);
+      if (info == digitizerInfo.end() || info->second.index == nullptr) {
+        return;
+      }
+    }
+    if (H5Fstart_swmr_write(file->getId()) < 0) {
+      std::cerr << "ERROR: could not start SWMR mode on HDF5-file \""
+                << file->getFileName() << "\" - writing it without" << std::endl;
+      swmr = false; // do not try again for every buffer
+      return;
+    }
+    swmrStarted = true;
+  }
+
+  void flush() {
+    try {
+      for (auto &itr : digitizerInfo) {
+        itr.second.flush();
+      }
+    } catch (H5::Exception &e) {
+      std::cerr << "Error while flushing HDF5 file: " << e.getDetailMsg() << std::endl;
+    }
+  }
+
+  void flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopFlushing) {
+      flushTimer.wait_for(lock, std::chrono::milliseconds(options.flushInterval));
+      if (stopFlushing) {
+        break;
+      }
+      if (swmrStarted) {
+        flush();
+      }
+    }
+  }
+
   void close() {
     assert(file);
+    swmrStarted = false;
     for (auto &itr : digitizerInfo) {
+      // The data first, so all of the index can follow
+      for (Dataset &dataset : itr.second.datasets) {
+        dataset.close();
+      }
+      if (itr.second.index) {
+        itr.second.closeEntry();
+        itr.second.writeIndex(true);
+        delete itr.second.index;
+      }
       if (itr.second.current)
         delete itr.second.current;
       if (itr.second.previous)
@@ -129,14 +423,214 @@ private:
     file = nullptr;
   }
 
+  /* Add a dataset of the Appended or Columns layout to info */
+  void createDataset(DigitizerInfo &info, const std::string &name,
+                     const H5::DataType &type, const jadaq::h5storage &storage) {
+    hsize_t chunkRows = storage.chunkRows(type.getSize(), chunkBytes);
+    Dataset dataset;
+    if (workers) {
+      dataset.direct = new jadaq::h5direct(*info.group, name, type, chunkRows, storage, *workers);
+    } else {
+      // Room for at least the chunk being filled and the one before
+      size_t cache = options.cacheBytes;
+      size_t needed = 2 * chunkRows * type.getSize();
+      if (needed > (cache > 0 ? cache : (size_t)defaultCacheBytes)) {
+        cache = needed;
+      }
+      dataset.library = new jadaq::h5append(*info.group, name, type, chunkRows, storage, cache);
+    }
+    info.datasets.push_back(dataset);
+  }
+
+  void createIndex(DigitizerInfo &info) {
+    info.index = new jadaq::h5append(*info.group, "index", IndexEntry::h5type(), indexChunkRows);
+  }
+
+  /* The datasets and index of the Appended or Columns layout for elements
+   * of type, rowType in a single data dataset. The Columns layout splits
+   * list elements only. */
+  void createDatasets(DigitizerInfo &info, Data::ElementType type, const H5::DataType &rowType) {
+    jadaq::h5storage storage = options.storageOf(type);
+    if (options.layout == Columns && (type == Data::List422 || type == Data::List8222)) {
+      createDataset(info, "time", type == Data::List8222 ? H5::PredType::NATIVE_UINT64
+                                                         : H5::PredType::NATIVE_UINT32, storage);
+      createDataset(info, "channel", H5::PredType::NATIVE_UINT16, storage);
+      createDataset(info, "charge", H5::PredType::NATIVE_UINT16, storage);
+      if (type == Data::List8222) {
+        createDataset(info, "baseline", H5::PredType::NATIVE_UINT16, storage);
+      }
+    } else {
+      createDataset(info, "data", rowType, storage);
+    }
+    createIndex(info);
+  }
+
+  /* HDF5 type of elements of type with samples samples in each waveform */
+  static H5::DataType rowType(Data::ElementType type, size_t samples) {
+    switch (type) {
+    case Data::List422:
+      return Data::ListElement422::h5type();
+    case Data::List8222:
+      return Data::ListElement8222::h5type();
+    case Data::Standard: {
+      Data::StdElement751 element;
+      element.waveform.num_samples = (uint16_t)samples;
+      return element.h5type();
+    }
+    case Data::Waveform422: {
+      Data::DPPQDCWaveformElement<Data::ListElement422> element;
+      element.waveform.num_samples = (uint16_t)samples;
+      return element.h5type();
+    }
+    case Data::Waveform8222: {
+      Data::DPPQDCWaveformElement<Data::ListElement8222> element;
+      element.waveform.num_samples = (uint16_t)samples;
+      return element.h5type();
+    }
+    case Data::Raw:
+      return Data::RawElement::h5type();
+    case Data::Hit:
+      return Data::HitElement::h5type();
+    case Data::Event:
+      return Data::EventElement::h5type();
+    default:
+      throw std::invalid_argument("No HDF5 type for data type " + std::to_string(type));
+    }
+  }
+
+  /* The group, data type attribute and, in the Appended and Columns layouts,
+   * the datasets of an added digitizer. The datasets can not be created
+   * later in SWMR mode. */
+  void addDatasets(uint32_t digitizerID, const Source &source) {
+    DigitizerInfo &info = getDigitizerInfo(digitizerID);
+    if (info.format == Data::ElementType::None) {
+      info.format = source.type;
+      writeAttribute("JADAQ_DATA_TYPE", *info.group, H5::PredType::NATIVE_UINT16, &info.format);
+    }
+    if (options.layout != Tables && info.index == nullptr) {
+      createDatasets(info, source.type, rowType(source.type, source.samples));
+    }
+  }
+
+  void writeError(DigitizerInfo &info, H5::Exception &e, uint64_t globalTimeStamp, size_t size) {
+    std::cerr << "Error while writing to HDF5 file: " << e.getDetailMsg()
+              << "\n\t "
+              << "HDF5::write( " << info.group->getObjName() << ", " << globalTimeStamp
+              << ", " << size << " )" << std::endl;
+  }
+
+  template <typename E>
+  void append(DigitizerInfo &info, const jadaq::buffer<E> *buffer,
+              uint64_t globalTimeStamp, uint16_t rollover) {
+    if (info.index == nullptr) {
+      createDatasets(info, E::type(), buffer->begin()->h5type());
+    }
+    try {
+      info.datasets.front().append(buffer->data() + sizeof(Data::Header), buffer->size());
+      info.addToIndex(globalTimeStamp, rollover, (uint32_t)buffer->size());
+    } catch (H5::Exception &e) {
+      writeError(info, e, globalTimeStamp, buffer->size());
+    }
+  }
+
+  static uint16_t baseline(const Data::ListElement422 &) { return 0; }
+  static uint16_t baseline(const Data::ListElement8222 &element) { return element.baseline; }
+
+  /* Columns layout: time, channel, charge and, with extras, baseline of list
+   * elements in datasets of their own. Only list elements are split, by the
+   * thread delivering them, so the writer lock is not held for it. The
+   * columns are kept per thread, time in the width of the element's. */
+  template <typename E>
+  static const jadaq::columns *columnsOf(const jadaq::buffer<E> *) { return nullptr; }
+  static const jadaq::columns *columnsOf(const jadaq::buffer<Data::ListElement422> *buffer) {
+    return columnsOfList(buffer);
+  }
+  static const jadaq::columns *columnsOf(const jadaq::buffer<Data::ListElement8222> *buffer) {
+    return columnsOfList(buffer);
+  }
+  template <typename L>
+  static const jadaq::columns *columnsOfList(const jadaq::buffer<L> *buffer) {
+    static thread_local std::unique_ptr<jadaq::columns> staging;
+    typedef typename L::time_t time_t;
+    size_t n = buffer->size();
+    if (!staging || staging->capacity() < n) {
+      staging.reset(new jadaq::columns(n));
+    }
+    staging->resize(n);
+    time_t *time = reinterpret_cast<time_t *>(staging->time());
+    uint16_t *channel = staging->channel();
+    uint16_t *charge = staging->charge();
+    uint16_t *baselines = staging->baseline();
+    size_t i = 0;
+    for (const L &element : *buffer) {
+      time[i] = element.time;
+      channel[i] = element.channel;
+      charge[i] = element.charge;
+      baselines[i] = baseline(element);
+      i += 1;
+    }
+    return staging.get();
+  }
+
+  template <typename L>
+  void appendColumns(DigitizerInfo &info, const jadaq::columns &split,
+                     uint64_t globalTimeStamp, uint16_t rollover) {
+    const bool extras = L::type() == Data::List8222;
+    if (info.index == nullptr) {
+      createDatasets(info, L::type(), L::h5type());
+    }
+    size_t n = split.size();
+    try {
+      info.datasets[0].append(split.time(), n);
+      info.datasets[1].append(split.channel(), n);
+      info.datasets[2].append(split.charge(), n);
+      if (extras) {
+        info.datasets[3].append(split.baseline(), n);
+      }
+      info.addToIndex(globalTimeStamp, rollover, (uint32_t)n);
+    } catch (H5::Exception &e) {
+      writeError(info, e, globalTimeStamp, n);
+    }
+  }
+  template <typename E>
+  void columns(DigitizerInfo &info, const jadaq::buffer<E> *buffer, const jadaq::columns *,
+               uint64_t globalTimeStamp, uint16_t rollover) {
+    append(info, buffer, globalTimeStamp, rollover);
+  }
+  void columns(DigitizerInfo &info, const jadaq::buffer<Data::ListElement422> *,
+               const jadaq::columns *split, uint64_t globalTimeStamp, uint16_t rollover) {
+    appendColumns<Data::ListElement422>(info, *split, globalTimeStamp, rollover);
+  }
+  void columns(DigitizerInfo &info, const jadaq::buffer<Data::ListElement8222> *,
+               const jadaq::columns *split, uint64_t globalTimeStamp, uint16_t rollover) {
+    appendColumns<Data::ListElement8222>(info, *split, globalTimeStamp, rollover);
+  }
+
 public:
   DataWriterHDF5(const std::string &pathname_, const std::string &basename_,
                  const std::string &&id)
-      : pathname(pathname_), basename(basename_) {
+      : DataWriterHDF5(pathname_, basename_, std::move(id), Options()) {}
+
+  DataWriterHDF5(const std::string &pathname_, const std::string &basename_,
+                 const std::string &&id, const Options &options_)
+      : pathname(pathname_), basename(basename_), options(options_) {
+    if (options.layout != Tables && options.workers > 0) {
+      workers.reset(new jadaq::task_pool(options.workers));
+    }
     open(id);
+    if (options.swmr) {
+      flusher = std::thread(&DataWriterHDF5::flushLoop, this);
+    }
   }
 
   ~DataWriterHDF5() {
+    if (flusher.joinable()) {
+      mutex.lock();
+      stopFlushing = true;
+      mutex.unlock();
+      flushTimer.notify_all();
+      flusher.join();
+    }
     mutex.lock(); // Wait if someone is still writing data
     close();
     mutex.unlock();
@@ -149,33 +643,68 @@ public:
     mutex.unlock();
   }
 
-  void addDigitizer(uint32_t digitizerID) {
-    mutex.lock();
-    getDigitizerInfo(digitizerID);
-    mutex.unlock();
+  void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (swmrStarted) {
+      throw std::logic_error("digitizer " + std::to_string(digitizerID) +
+                             " can not be added to an HDF5 file in SWMR mode");
+    }
+    Source &source = digitizers[digitizerID];
+    source.type = type;
+    source.samples = samples;
+    addDatasets(digitizerID, source);
   }
 
   static bool network() { return false; }
 
+  /* Large appends keep the per-call overhead and locking down */
+  static constexpr const size_t defaultBufferSize = 4 << 20;
+  size_t bufferSize() const { return defaultBufferSize; }
+
   template <typename E>
   void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
                   uint64_t globalTimeStamp) {
     if (buffer->size() < 1)
       return;
+    const jadaq::columns *split = options.layout == Columns ? columnsOf(buffer) : nullptr;
     mutex.lock();
+    if (swmrStarted) {
+      auto itr = digitizerInfo.find(digitizerID);
+      if (itr == digitizerInfo.end() || itr->second.index == nullptr) {
+        mutex.unlock();
+        throw std::logic_error("digitizer " + std::to_string(digitizerID) +
+                               " was not added to the HDF5 file before SWMR mode started");
+      }
+    }
     DigitizerInfo &info = getDigitizerInfo(digitizerID);
     if (info.format == Data::ElementType::None){
       // write data format identifier to file
       info.format = E::type();
       writeAttribute("JADAQ_DATA_TYPE", *info.group, H5::PredType::NATIVE_UINT16, &info.format);
     }
-    FL_PacketTable *&table = info.getTable(globalTimeStamp);
+    uint16_t rollover = reinterpret_cast<const Data::Header *>(buffer->data())->rollover;
+    if (options.layout != Tables) {
+      if (options.layout == Columns) {
+        columns(info, buffer, split, globalTimeStamp, rollover);
+      } else {
+        append(info, buffer, globalTimeStamp, rollover);
+      }
+      if (swmr && !swmrStarted) {
+        startSwmr();
+      }
+      mutex.unlock();
+      return;
+    }
+    FL_PacketTable *&table = info.getTable(globalTimeStamp, rollover);
     if (table == nullptr) {
-      /// \todo (char*) cast used to get rid of warning, maybe check this is OK?
+      H5::DataType type = buffer->begin()->h5type();
+      jadaq::h5storage storage = options.storageOf(E::type());
+      // Without a chunk size given, a chunk is the first package
+      hsize_t chunkRows = storage.chunkRows(type.getSize(), buffer->size() * type.getSize());
+      H5::DSetCreatPropList plist = storage.createList(chunkRows);
       table = new FL_PacketTable(
-          info.group->getId(), (char *)std::to_string(globalTimeStamp).c_str(),
-          buffer->begin()->h5type().getId(),
-          buffer->size()); // TODO find a suitable chunk size - last argument
+          info.group->getId(), DigitizerInfo::tableName(globalTimeStamp, rollover).c_str(),
+          type.getId(), chunkRows, plist.getId());
     }
     if (table->AppendPackets(
             buffer->size(),
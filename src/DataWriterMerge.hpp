@@ -0,0 +1,267 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Merge the list mode data from all digitizers into one time ordered stream
+ * of Data::HitElement, which is passed on to another DataWriter. Every group
+ * of every digitizer is a stream of its own. Optionally the merged hits are
+ * grouped into coincidence events, written as Data::EventElement instead.
+ * Waveform, standard and raw data are passed on unmerged.
+ *
+ */
+
+#ifndef JADAQ_DATAWRITERMERGE_HPP
+#define JADAQ_DATAWRITERMERGE_HPP
+
+#include "DataFormat.hpp"
+#include "DataWriter.hpp"
+#include "EventBuilder.hpp"
+#include "container.hpp"
+#include "merge.hpp"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class DataWriterMerge {
+public:
+  struct Stats {
+    std::atomic<uint64_t> hits{0};    // hits written in time order
+    std::atomic<uint64_t> late{0};    // hits written after a later one
+    std::atomic<uint64_t> pending{0}; // hits waiting in the reorder window
+    std::atomic<uint64_t> events{0};  // coincidence events written
+    std::atomic<uint64_t> discarded{0}; // hits in events below the multiplicity trigger
+  };
+
+private:
+  /* DPP-QDC groups hold 8 channels each */
+  static constexpr const unsigned groupShift = 3;
+
+  /* Streams are created as groups deliver data, until then a placeholder
+   * stops the merge from running ahead of the digitizer */
+  struct Source {
+    bool placeholder = false;
+    size_t index = 0;
+    std::vector<size_t> groups; // stream index in the merge
+  };
+
+  /* Output is collected in pooled buffers, so a DataWriter further on may
+   * hold on to them */
+  template <typename E> struct Output {
+    jadaq::buffer_pool<E> pool;
+    jadaq::buffer<E> *buffer;
+    std::chrono::steady_clock::time_point filled; // first element in buffer
+    explicit Output(size_t size) : pool(size, E::size(), sizeof(Data::Header)) {
+      pool.reserve(2);
+      buffer = pool.acquire();
+    }
+    ~Output() { buffer->release(); }
+  };
+
+  DataWriter sink;
+  jadaq::time_merge<Data::HitElement> merge;
+  std::map<uint32_t, Source> sources;
+  std::unique_ptr<EventBuilder> builder; // only when building events
+  Output<Data::HitElement> out;
+  Output<Data::EventElement> events;
+  uint64_t globalTimeStamp = 0;
+  std::chrono::steady_clock::duration handoffInterval;
+  Stats stats_;
+  std::mutex mutex;
+
+  size_t stream(std::vector<size_t> &groups, uint16_t channel) {
+    size_t group = channel >> groupShift;
+    while (groups.size() <= group) {
+      groups.push_back(merge.add_stream());
+    }
+    return groups[group];
+  }
+
+  /* The DataHandler counts the rollovers of the 32-bit time tag for each
+   * package, the 64-bit time of ListElement8222 already includes them */
+  static uint64_t extend(uint16_t rollover, uint32_t time) {
+    return ((uint64_t)rollover << 32) | time;
+  }
+  static uint64_t extend(uint16_t, uint64_t time) { return time; }
+
+  static uint16_t baseline(const Data::ListElement422 &) { return 0; }
+  static uint16_t baseline(const Data::ListElement8222 &e) { return e.baseline; }
+
+  template <typename E> void write(Output<E> &output) {
+    if (!output.buffer->empty()) {
+      jadaq::buffer<E> *full = output.buffer;
+      sink(full, Data::mergedID, globalTimeStamp);
+      output.buffer = output.pool.acquire();
+      if (output.buffer == nullptr) {
+        output.buffer = output.pool.allocate();
+      }
+      full->release();
+    }
+  }
+  void write() {
+    write(out);
+    write(events);
+  }
+
+  template <typename E> void put(Output<E> &output, const E &element) {
+    if (output.buffer->full()) {
+      write(output);
+    }
+    if (output.buffer->empty() && handoffInterval.count() > 0) {
+      output.filled = std::chrono::steady_clock::now();
+    }
+    output.buffer->push_back(element);
+  }
+
+  /* Write the output buffers that hold data for longer than handoffInterval */
+  void writeAged() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!out.buffer->empty() && now - out.filled >= handoffInterval) {
+      write(out);
+    }
+    if (!events.buffer->empty() && now - events.filled >= handoffInterval) {
+      write(events);
+    }
+  }
+
+  void drain(bool all) {
+    auto event = [this](const Data::EventElement &element) { put(events, element); };
+    auto hit = [this, &event](const Data::HitElement &element) {
+      if (builder) {
+        builder->push(element, event);
+      } else {
+        put(out, element);
+      }
+    };
+    if (all) {
+      merge.flush(hit);
+      if (builder) {
+        builder->close(event);
+      }
+    } else {
+      merge.drain(hit);
+    }
+    stats_.hits = merge.merged();
+    stats_.late = merge.late();
+    stats_.pending = merge.pending();
+    if (builder) {
+      stats_.events = builder->events();
+      stats_.discarded = builder->discarded();
+    }
+  }
+
+  template <typename E>
+  void mergeList(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
+                 uint64_t timeStamp) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Source &source = sources[digitizerID];
+    if (source.placeholder) {
+      merge.close_stream(source.index);
+      source.placeholder = false;
+    }
+    std::vector<size_t> &groups = source.groups;
+    uint16_t rollover = reinterpret_cast<const Data::Header *>(buffer->data())->rollover;
+    for (const E &element : *buffer) {
+      size_t index = stream(groups, element.channel);
+      Data::HitElement hit;
+      hit.time = extend(rollover, element.time);
+      hit.digitizerID = digitizerID;
+      hit.channel = element.channel;
+      hit.charge = element.charge;
+      hit.baseline = baseline(element);
+      merge.push(index, hit);
+    }
+    globalTimeStamp = std::max(globalTimeStamp, timeStamp);
+    drain(false);
+    if (handoffInterval.count() > 0) {
+      writeAged();
+    }
+  }
+
+public:
+  /* window: reorder window in time tag units
+   * coincidence: coincidence window in time tag units, 0 disables event building
+   * multiplicity: least number of hits in an event
+   * handoff: also write output that is older than handoff milliseconds when
+   * data arrives, 0 only writes full buffers */
+  DataWriterMerge(DataWriter &&sink_, uint64_t window, uint64_t coincidence = 0,
+                  size_t multiplicity = 1, unsigned handoff = 0)
+      : sink(std::move(sink_)), merge(window),
+        out(sink.bufferSize()), events(sink.bufferSize()),
+        handoffInterval(std::chrono::milliseconds(handoff)) {
+    if (coincidence > 0) {
+      builder.reset(new EventBuilder(coincidence, multiplicity));
+    }
+    sink.addDigitizer(Data::mergedID, builder ? Data::Event : Data::Hit, 0);
+  }
+
+  ~DataWriterMerge() {
+    std::lock_guard<std::mutex> lock(mutex);
+    drain(true);
+    write();
+    // The sink goes first, as it may still hold buffers from our pools
+    DataWriter last(std::move(sink));
+  }
+
+  /* List mode digitizers are streams of the merge and reach the sink as
+   * the merged stream only */
+  void addDigitizer(uint32_t digitizerID, Data::ElementType type, size_t samples) {
+    if (type != Data::List422 && type != Data::List8222) {
+      sink.addDigitizer(digitizerID, type, samples);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    Source &source = sources[digitizerID];
+    if (source.groups.empty() && !source.placeholder) {
+      source.placeholder = true;
+      source.index = merge.add_stream();
+    }
+  }
+
+  /* Everything received so far goes to the current file */
+  void split(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    drain(true);
+    write();
+    sink.split(id);
+  }
+
+  size_t bufferSize() const { return sink.bufferSize(); }
+
+  const Stats &stats() const { return stats_; }
+
+  void operator()(const jadaq::buffer<Data::ListElement422> *buffer,
+                  uint32_t digitizerID, uint64_t globalTimeStamp) {
+    mergeList(buffer, digitizerID, globalTimeStamp);
+  }
+  void operator()(const jadaq::buffer<Data::ListElement8222> *buffer,
+                  uint32_t digitizerID, uint64_t globalTimeStamp) {
+    mergeList(buffer, digitizerID, globalTimeStamp);
+  }
+  template <typename E>
+  void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
+                  uint64_t globalTimeStamp) {
+    sink(buffer, digitizerID, globalTimeStamp);
+  }
+};
+
+#endif // JADAQ_DATAWRITERMERGE_HPP
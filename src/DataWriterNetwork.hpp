@@ -31,6 +31,9 @@
 #include <boost/asio.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
+#include <array>
+#include <mutex>
 #include "xtrace.h"
 
 using boost::asio::ip::udp;
@@ -42,6 +45,7 @@ private:
   udp::endpoint remoteEndpoint;
   udp::socket *socket = nullptr;
   uint32_t seqNum{0};
+  std::mutex mutex; // Readout threads share the socket and sequence number
 
 public:
   DataWriterNetwork(const std::string &address, const std::string &port, uint64_t runID_)
@@ -60,26 +64,44 @@ public:
     }
   }
 
-  void addDigitizer(uint32_t digitizerID) {
+  void addDigitizer(uint32_t digitizerID, Data::ElementType, size_t) {
     // TODO: This is where we will send the configuration over TCP
   }
 
   void split(const std::string&) {}
 
+  /* A buffer of this size is sent as one datagram */
+  size_t bufferSize() const { return Data::maxBufferSize; }
+
+  /* Larger buffers, sized for another output sharing them (see
+   * DataWriterFanout), are sent as several datagrams with a header each.
+   * The header is built here, as the buffer may be shared. */
   template <typename E>
   void operator()(const jadaq::buffer<E> *buffer, uint32_t digitizerID,
                   uint64_t globalTimeStamp) {
-    Data::Header *header = (Data::Header *)buffer->data();
-    header->seqNum = seqNum;
-    seqNum++;
-    header->runID = runID;
-    header->globalTime = globalTimeStamp;
-    header->digitizerID = digitizerID;
-    header->version = Data::currentVersion;
-    header->elementType = E::type();
-    header->numElements = (uint16_t)buffer->size();
-    socket->send_to(boost::asio::buffer(buffer->data(), buffer->data_size()),
-                    remoteEndpoint);
+    Data::Header header = *reinterpret_cast<const Data::Header *>(buffer->data());
+    header.runID = runID;
+    header.globalTime = globalTimeStamp;
+    header.digitizerID = digitizerID;
+    header.version = Data::currentVersion;
+    header.elementType = E::type();
+    const char *data = buffer->data() + buffer->header_size();
+    size_t n = buffer->size();
+    size_t elementSize = n > 0 ? (buffer->data_size() - buffer->header_size()) / n : 1;
+    size_t perDatagram = std::max<size_t>((Data::maxBufferSize - sizeof(Data::Header)) / elementSize, 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t first = 0;
+    do {
+      size_t count = std::min(n - first, perDatagram);
+      header.seqNum = seqNum;
+      seqNum++;
+      header.numElements = (uint16_t)count;
+      std::array<boost::asio::const_buffer, 2> datagram = {
+          {boost::asio::buffer(&header, sizeof(header)),
+           boost::asio::buffer(data + first * elementSize, count * elementSize)}};
+      socket->send_to(datagram, remoteEndpoint);
+      first += count;
+    } while (first < n);
   }
 };
 
@@ -68,7 +68,7 @@ public:
     mutex.unlock();
   }
 
-  void addDigitizer(uint32_t digitizerID) {
+  void addDigitizer(uint32_t digitizerID, Data::ElementType, size_t) {
     mutex.lock();
     *file << "# digitizerID: " << digitizerID << std::endl;
     mutex.unlock();
@@ -76,6 +76,9 @@ public:
 
   static bool network() { return false; }
 
+  static constexpr const size_t defaultBufferSize = 1 << 20;
+  size_t bufferSize() const { return defaultBufferSize; }
+
   void split(const std::string &id) {
     mutex.lock();
     close();
@@ -89,7 +92,12 @@ public:
     mutex.lock();
     *file << "#" << PRINTH(digitizer) << " ";
     E::headerOn(*file);
-    *file << std::endl << "@" << globalTimeStamp << std::endl;
+    *file << std::endl << "@" << globalTimeStamp;
+    uint16_t rollover = reinterpret_cast<const Data::Header *>(buffer->data())->rollover;
+    if (rollover > 0) {
+      *file << " rollover: " << rollover;
+    }
+    *file << std::endl;
     for (const E &element : *buffer) {
       *file << " " << PRINTD(digitizer) << " " << element << "\n";
     }
@@ -313,26 +313,46 @@ Digitizer::Digitizer(CAEN_DGTZ_ConnectionType linkType_, int linkNum_, int conet
     id = digitizer->serialNumber();
 }
 
-void Digitizer::initialize(DataWriter& dataWriter)
+caen::ReadoutBuffer Digitizer::mallocReadoutBuffer()
+{
+  // ECDC_NULL_CONNECTION
+  if (id == 0xaaaabbbb) {
+    caen::ReadoutBuffer buffer;
+    buffer.size = 9000;
+    buffer.data = (char *)malloc(9000);
+    return buffer;
+  }
+  return digitizer->mallocReadoutBuffer();
+}
+
+void Digitizer::initialize(DataWriter& dataWriter, size_t readoutBuffers, bool raw, size_t timeSlots,
+                           bool hugePages)
 {
   XTRACE(DIGIT, DEB, "Digitizer::initialize()");
   XTRACE(DIGIT, DEB, "Prepare readout buffer for digitizer %s", name().c_str());
 
+  if (readoutBuffers > 0) {
+    XTRACE(DIGIT, DEB, "Prepare pool of %d readout buffers for digitizer %s", readoutBuffers, name().c_str());
+    freeBuffers.reset(new jadaq::spsc_ring<caen::ReadoutBuffer *>(readoutBuffers));
+    filledBuffers.reset(new jadaq::spsc_ring<caen::ReadoutBuffer *>(readoutBuffers));
+    readoutPool.reserve(readoutBuffers);
+    for (size_t i = 0; i < readoutBuffers; ++i) {
+      readoutPool.push_back(mallocReadoutBuffer());
+      freeBuffers->push(&readoutPool.back());
+    }
+  }
+
   // ECDC_NULL_CONNECTION
   if (id == 0xaaaabbbb) {
-    readoutBuffer.size = 9000;
-    readoutBuffer.data = (char *)malloc(9000);
+    readoutBuffer = mallocReadoutBuffer();
     uint32_t groups = 16;
     acqWindowSize = new uint32_t[groups];
-    dataWriter.addDigitizer(digitizerID());
-    dataHandler.initialize<Data::ListElement422>(dataWriter, digitizerID(), groups,
-                                                 waveforms, acqWindowSize);
+    initializeHandler<Data::ListElement422, DPPQDCEventIterator>(dataWriter, groups, raw, timeSlots, hugePages);
     return;
   }
 
 
-    readoutBuffer = digitizer->mallocReadoutBuffer();
-    dataWriter.addDigitizer(digitizerID());
+    readoutBuffer = mallocReadoutBuffer();
     // model- and firmware-dependent initialization
     switch (digitizer->familyCode()){
     case CAEN_DGTZ_XX751_FAMILY_CODE:
@@ -361,7 +381,7 @@ void Digitizer::initialize(DataWriter& dataWriter)
             // TODO: initialize acqWindowSize elsewhere for all digitizer types
             acqWindowSize[i] = 0; // no "jitter" expected
           }
-          dataHandler.initialize<Data::StdElement751>(dataWriter,digitizerID(), groups(), waveforms, acqWindowSize);
+          initializeHandler<Data::StdElement751, StdBLTEventIterator>(dataWriter, groups(), raw, timeSlots, hugePages);
           break;
         }
         default:
@@ -402,16 +422,16 @@ void Digitizer::initialize(DataWriter& dataWriter)
             if (waveforms)
               {
                 if (extras)
-                    dataHandler.initialize<Data::DPPQDCWaveformElement<Data::ListElement8222> >(dataWriter,digitizerID(),groups,waveforms,acqWindowSize);
+                    initializeHandler<Data::DPPQDCWaveformElement<Data::ListElement8222>, DPPQDCEventIterator>(dataWriter,groups,raw,timeSlots,hugePages);
                 else
-                    dataHandler.initialize<Data::DPPQDCWaveformElement<Data::ListElement422> >(dataWriter,digitizerID(),groups,waveforms,acqWindowSize);
+                    initializeHandler<Data::DPPQDCWaveformElement<Data::ListElement422>, DPPQDCEventIterator>(dataWriter,groups,raw,timeSlots,hugePages);
             }
             else if (extras)
             {
-                dataHandler.initialize<Data::ListElement8222>(dataWriter,digitizerID(),groups,waveforms,acqWindowSize);
+                initializeHandler<Data::ListElement8222, DPPQDCEventIterator>(dataWriter,groups,raw,timeSlots,hugePages);
             } else
             {
-                dataHandler.initialize<Data::ListElement422>(dataWriter,digitizerID(),groups,waveforms,acqWindowSize);
+                initializeHandler<Data::ListElement422, DPPQDCEventIterator>(dataWriter,groups,raw,timeSlots,hugePages);
             }
             break;
           }
@@ -438,6 +458,7 @@ void Digitizer::initialize(DataWriter& dataWriter)
     if (bytesFlushed>0){
       XTRACE(DIGIT, WAR, "Flushed %db of data still in digitizer buffer", bytesRead);
     }
+    initializeTimer.reset();
 }
 
 void Digitizer::close() {
@@ -446,6 +467,10 @@ void Digitizer::close() {
     return;
   }
   digitizer->freeReadoutBuffer(readoutBuffer);
+  for (caen::ReadoutBuffer &buffer : readoutPool) {
+    digitizer->freeReadoutBuffer(buffer);
+  }
+  readoutPool.clear();
   if (digitizer) {
     delete digitizer;
     digitizer = nullptr;
@@ -458,113 +483,152 @@ bool Digitizer::ready() {
   return acqStatus.boardReady() && acqStatus.PLLready();
 }
 
-void Digitizer::startAcquisition() {
+void Digitizer::waitReady() {
   if (id == 0xaaaabbbb) {
     return;
   }
-  // fixed minimum wait for digitizer to be ready (value determined experimentally):
-  std::this_thread::sleep_for(std::chrono::milliseconds(175));
+  // fixed minimum wait after initialize() for digitizer to be ready (value determined experimentally):
+  uint64_t elapsed = initializeTimer.elapsedms();
+  if (elapsed < 175)
+    std::this_thread::sleep_for(std::chrono::milliseconds(175 - elapsed));
     // additional wait if necessary:
   while (!ready())
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+void Digitizer::startAcquisition() {
+  if (id == 0xaaaabbbb) {
+    return;
+  }
   digitizer->startAcquisition();
 }
 
+void Digitizer::enableInterrupt(uint16_t aggregates) {
+  XTRACE(DIGIT, DEB, "Enable interrupt on %d aggregates for digitizer %s", aggregates, name().c_str());
+  caen::InterruptConfig interruptConfig;
+  interruptConfig.state = CAEN_DGTZ_ENABLE;
+  interruptConfig.level = 1; // must be 1 for direct connection through CONET
+  interruptConfig.status_id = 0xAAAA;
+  interruptConfig.event_number = aggregates;
+  interruptConfig.mode = CAEN_DGTZ_IRQ_MODE_ROAK;
+  digitizer->setInterruptConfig(interruptConfig);
+  interruptAggregates = aggregates;
+}
+
+void Digitizer::disableInterrupt() {
+  caen::InterruptConfig interruptConfig = digitizer->getInterruptConfig();
+  interruptConfig.state = CAEN_DGTZ_DISABLE;
+  digitizer->setInterruptConfig(interruptConfig);
+  interruptAggregates = 0;
+}
+
+/* Block until the digitizer raises an interrupt or timeout (ms) expires.
+ * Returns false on timeout. */
+bool Digitizer::waitForInterrupt(uint32_t timeout) {
+  try {
+    digitizer->doIRQWait(timeout);
+  } catch (caen::Error &e) {
+    if (e.code() == CAEN_DGTZ_Timeout) {
+      return false;
+    }
+    throw;
+  }
+  return true;
+}
+
 void Digitizer::acquisition() {
-  XTRACE(DIGIT, DEB, "Read at most %db data from %s", readoutBuffer.size, name().c_str());
+  if (readBuffer(readoutBuffer) > 0) {
+    (this->*decodeBuffer)(readoutBuffer);
+  } else {
+    dataHandler.handoffAged();
+  }
+}
+
+bool Digitizer::readout() {
+  caen::ReadoutBuffer *buffer;
+  if (!freeBuffers->pop(buffer)) {
+    XTRACE(DIGIT, DEB, "No free readout buffer for %s - decoder is behind", name().c_str());
+    return false;
+  }
+  if (readBuffer(*buffer) > 0) {
+    filledBuffers->push(buffer);
+  } else {
+    freeBuffers->push(buffer);
+  }
+  return true;
+}
+
+bool Digitizer::decode() {
+  caen::ReadoutBuffer *buffer;
+  if (!filledBuffers->pop(buffer)) {
+    dataHandler.handoffAged();
+    return false;
+  }
+  (this->*decodeBuffer)(*buffer);
+  freeBuffers->push(buffer);
+  return true;
+}
+
+uint32_t Digitizer::readBuffer(caen::ReadoutBuffer &buffer) {
+  XTRACE(DIGIT, DEB, "Read at most %db data from %s", buffer.size, name().c_str());
 
   // NULL Digitizer "readout"
   if (id == 0xaaaabbbb) {
-    memset(readoutBuffer.data, 0x00, 2048); // emulate readData() function
-    (*(uint32_t *)(readoutBuffer.data +  0)) = 0xa0000030;  // magic value 0xa + size of
-    (*(uint32_t *)(readoutBuffer.data +  4)) = 0x00000001;  // group mask 1
-    (*(uint32_t *)(readoutBuffer.data +  8)) = 0x00000000;  // unused ?
-    (*(uint32_t *)(readoutBuffer.data + 12)) = 0x00000000; // unused ?
+    memset(buffer.data, 0x00, 2048); // emulate readData() function
+    (*(uint32_t *)(buffer.data +  0)) = 0xa0000030;  // magic value 0xa + size of
+    (*(uint32_t *)(buffer.data +  4)) = 0x00000001;  // group mask 1
+    (*(uint32_t *)(buffer.data +  8)) = 0x00000000;  // unused ?
+    (*(uint32_t *)(buffer.data + 12)) = 0x00000000; // unused ?
 
     // Group 0 - channels 0 - 15
-    (*(uint32_t *)(readoutBuffer.data + 16)) = 0x80000020; // MSB 1 + data size 32 bytes
-    (*(uint32_t *)(readoutBuffer.data + 20)) = 0x60000001; // 0110 0 ....
+    (*(uint32_t *)(buffer.data + 16)) = 0x80000020; // MSB 1 + data size 32 bytes
+    (*(uint32_t *)(buffer.data + 20)) = 0x60000001; // 0110 0 ....
 
-    (*(uint32_t *)(readoutBuffer.data + 24)) = 0x01020304; // Time
-    (*(uint32_t *)(readoutBuffer.data + 28)) = 0x00001000; // subch 0, charge 4096
+    (*(uint32_t *)(buffer.data + 24)) = 0x01020304; // Time
+    (*(uint32_t *)(buffer.data + 28)) = 0x00001000; // subch 0, charge 4096
 
-    (*(uint32_t *)(readoutBuffer.data + 32)) = 0x01020305; // Time
-    (*(uint32_t *)(readoutBuffer.data + 36)) = 0x00001000; // subch 0, charge 4096
+    (*(uint32_t *)(buffer.data + 32)) = 0x01020305; // Time
+    (*(uint32_t *)(buffer.data + 36)) = 0x00001000; // subch 0, charge 4096
 
-    (*(uint32_t *)(readoutBuffer.data + 40)) = 0x01020306; // Time
-    (*(uint32_t *)(readoutBuffer.data + 44)) = 0xf0001000; // subch 15, charge 4096
+    (*(uint32_t *)(buffer.data + 40)) = 0x01020306; // Time
+    (*(uint32_t *)(buffer.data + 44)) = 0xf0001000; // subch 15, charge 4096
 
-    readoutBuffer.dataSize = 48; // emulate readData() function
-    stats.bytesRead += readoutBuffer.dataSize;
-
-    DPPQDCEventIterator iterator{readoutBuffer};
-    size_t events = dataHandler(iterator);
-    stats.eventsFound += events;
+    buffer.dataSize = 48; // emulate readData() function
+    stats.bytesRead += buffer.dataSize;
+    pollScheduler.update(buffer.dataSize, buffer.size, false);
+    stats.pollInterval = pollScheduler.current();
     //usleep(1000000);
-    return;
+    return buffer.dataSize;
   }
 
   /* We use slave terminated mode like in the sample from CAEN Digitizer library
    * docs. */
-  digitizer->readData(readoutBuffer, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT);
-  uint32_t bytesRead = readoutBuffer.dataSize;
+  digitizer->readData(buffer, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT);
+  uint32_t bytesRead = buffer.dataSize;
   XTRACE(DIGIT, DEB, "Read %db of acquired data", bytesRead);
   stats.readouts++;
 
+  /* Ask the digitizer if it has more data ready right away, so the poll
+   * interval can be shortened before its memory fills up */
+  bool moreReady = false;
+  if (bytesRead > 0 && readoutStatusSupported) {
+    try {
+      caen::Digitizer::ReadoutStatus readoutStatus{digitizer->getReadoutStatus()};
+      moreReady = readoutStatus.eventReady();
+    } catch (caen::Error &e) {
+      if (e.code() != CAEN_DGTZ_FunctionNotAllowed)
+        throw;
+      readoutStatusSupported = false;
+    }
+  }
+  pollScheduler.update(bytesRead, buffer.size, moreReady);
+  stats.pollInterval = pollScheduler.current();
+
   /* NOTE: check and skip if there's no actual events to handle */
   if (bytesRead < 1) {
     XTRACE(DIGIT, DEB, "No data to read - skip further handling.");
-    return;
+    return 0;
   }
   stats.bytesRead += bytesRead;
-
-    // model- and firmware-dependent acquisition
-    switch (digitizer->familyCode()){
-    case CAEN_DGTZ_XX751_FAMILY_CODE:
-      switch ((int)firmware) //Cast to int as long as CAEN_DGTZ_DPPFirmware_QDC is not part of the enumeration
-        {
-        case CAEN_DGTZ_NotDPPFirmware:
-          {
-          StdBLTEventIterator iterator{readoutBuffer};
-          size_t events = dataHandler(iterator);
-          stats.eventsFound += events;
-          break;
-          }
-        default:
-          throw std::runtime_error("Data acquisition not implemented by jadaq::Digitizer for firmware present on " + digitizer->modelName());
-        }
-      break;
-    case CAEN_DGTZ_XX740_FAMILY_CODE:
-      switch ((int)firmware) //Cast to int as long as CAEN_DGTZ_DPPFirmware_QDC is not part of the enumeration
-        {
-        case CAEN_DGTZ_DPPFirmware_PHA:
-          throw std::runtime_error("PHA firmware not supported by jadaq::Digitizer on " + digitizer->modelName());
-          break;
-        case CAEN_DGTZ_DPPFirmware_PSD:
-          throw std::runtime_error("PSD firmware not supported by jadaq::Digitizer on " + digitizer->modelName());
-          break;
-        case CAEN_DGTZ_DPPFirmware_CI:
-          throw std::runtime_error("CI firmware not supported by jadaq::Digitizer on " + digitizer->modelName());
-          break;
-        case CAEN_DGTZ_DPPFirmware_ZLE:
-          throw std::runtime_error("ZLE firmware not supported by jadaq::Digitizer on " + digitizer->modelName());
-          break;
-        case CAEN_DGTZ_DPPFirmware_QDC:
-          {
-            DPPQDCEventIterator iterator{readoutBuffer};
-            size_t events = dataHandler(iterator);
-            stats.eventsFound += events;
-            break;
-          }
-        case CAEN_DGTZ_NotDPPFirmware:
-          throw std::runtime_error("Non DPP firmware not supported by jadaq::Digitizer on " + digitizer->modelName());
-          break;
-        default:
-          throw std::runtime_error("Unknown firmware type. Not supported by jadaq::Digitizer on " + digitizer->modelName());
-        }
-      break;
-    default:
-      throw std::runtime_error("Unknown digitizer type. Not supported by jadaq::Digitizer on " + digitizer->modelName());
-    }
-
+  return bytesRead;
 }
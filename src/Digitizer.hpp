@@ -32,9 +32,13 @@
 #include "caen.hpp"
 #include "DataHandler.hpp"
 #include "DataWriter.hpp"
+#include "PollScheduler.hpp"
+#include "ring.hpp"
+#include "timer.h"
 #include <atomic>
 #include <boost/thread/thread.hpp>
 #include <chrono>
+#include <memory>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -42,10 +46,19 @@
 
 class Digitizer {
 public:
+  /* Stats are updated by the readout thread and read by run control and the
+   * stats printer, so they must be safe to access concurrently. */
   struct Stats {
-    uint64_t bytesRead = 0;
-    uint64_t eventsFound = 0;
-    uint64_t readouts = 0;
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> eventsFound{0};
+    std::atomic<uint64_t> readouts{0};
+    std::atomic<uint32_t> pollInterval{0}; // microseconds
+    Stats() = default;
+    Stats(const Stats &other)
+        : bytesRead(other.bytesRead.load()),
+          eventsFound(other.eventsFound.load()),
+          readouts(other.readouts.load()),
+          pollInterval(other.pollInterval.load()) {}
   };
 
 private:
@@ -59,7 +72,41 @@ private:
   DataHandler dataHandler;
   std::set<uint32_t> manipulatedRegisters;
   caen::ReadoutBuffer readoutBuffer;
+  /* Optional pool of readout buffers passed between the readout and the
+   * decoder thread, so decoding never stalls the link */
+  std::vector<caen::ReadoutBuffer> readoutPool;
+  std::unique_ptr<jadaq::spsc_ring<caen::ReadoutBuffer *> > freeBuffers;
+  std::unique_ptr<jadaq::spsc_ring<caen::ReadoutBuffer *> > filledBuffers;
   Stats stats;
+  uint16_t interruptAggregates = 0; // 0: interrupts disabled
+  PollScheduler pollScheduler;
+  SteadyTimer initializeTimer; // time since initialize()
+  bool readoutStatusSupported = true;
+  caen::ReadoutBuffer mallocReadoutBuffer();
+  uint32_t readBuffer(caen::ReadoutBuffer &buffer);
+  /* Decoder for the model and firmware at hand - selected in initialize() */
+  size_t (Digitizer::*decodeBuffer)(caen::ReadoutBuffer &buffer) = nullptr;
+  template <typename I> size_t decode(caen::ReadoutBuffer &buffer) {
+    I iterator{buffer};
+    size_t events = dataHandler(iterator);
+    stats.eventsFound += events;
+    return events;
+  }
+  /* Set up the DataHandler and the decoder for element type E read with I.
+   * In raw mode the readout data is passed on undecoded instead:
+   * StdBLTEventIterator only checks the leading 0xA word, which DPP board
+   * aggregates share, so it hands over the readout buffer for all firmwares. */
+  template <typename E, typename I>
+  void initializeHandler(DataWriter &dataWriter, uint32_t groups, bool raw, size_t timeSlots, bool hugePages) {
+    if (raw) {
+      dataHandler.initialize<Data::RawElement>(dataWriter, digitizerID(), groups, 0, acqWindowSize, timeSlots,
+                                               hugePages);
+      decodeBuffer = &Digitizer::decode<StdBLTEventIterator>;
+    } else {
+      dataHandler.initialize<E>(dataWriter, digitizerID(), groups, waveforms, acqWindowSize, timeSlots, hugePages);
+      decodeBuffer = &Digitizer::decode<I>;
+    }
+  }
 
 public:
   /* Connection parameters */
@@ -68,6 +115,7 @@ public:
   const int conetNode;
   const uint32_t VMEBaseAddress;
   bool active = false;
+  int core = -1; // CPU core to pin the readout thread to (-1: no pinning)
   Digitizer() = delete;
   Digitizer(Digitizer &) = delete;
   Digitizer(Digitizer &&) = default;
@@ -94,19 +142,52 @@ public:
   std::string get(FunctionID functionID);
   std::string get(FunctionID functionID, int index);
   void acquisition();
+  /* Decoupled acquisition: readout() and decode() must be called from one
+   * thread each, and only after initialize() was given a readout pool. */
+  bool readout();
+  bool decode();
   const std::set<uint32_t> &getRegisters() const { return manipulatedRegisters; }
   bool ready();
+  void waitReady();
   void startAcquisition();
   const Stats &getStats() const { return stats; }
+  /* Only valid after initialize() */
+  const DataHandler::Stats &getHandlerStats() const { return dataHandler.stats(); }
+  /* Only after initialize() and before the acquisition starts */
+  void enableHistograms(unsigned bins, bool extras) { dataHandler.histogram(bins, extras); }
+  /* nullptr unless enabled */
+  const Histograms *getHistograms() const { return dataHandler.histograms(); }
+  /* Only after initialize(): pass data on at least every ms milliseconds */
+  void setHandoffInterval(unsigned ms) { dataHandler.handoffInterval(ms); }
+  void setPollLimits(uint32_t min, uint32_t max) {
+    pollScheduler = PollScheduler(min, max);
+    stats.pollInterval = pollScheduler.current();
+  }
+  /* Microseconds until the digitizer should be polled again */
+  uint32_t pollRemaining() const { return pollScheduler.remaining(); }
   // TODO: Sould we do somthing different than expose these functions?
   void stopAcquisition() {
     if (id == 0xaaaabbbb) {
       return;
     }
     digitizer->stopAcquisition();
+    if (interruptAggregates > 0) {
+      disableInterrupt();
+    }
   }
+  /* Interrupt driven readout - only supported on optical links */
+  bool interruptCapable() const { return linkType == CAEN_DGTZ_OpticalLink; }
+  bool interruptEnabled() const { return interruptAggregates > 0; }
+  void enableInterrupt(uint16_t aggregates);
+  void disableInterrupt();
+  bool waitForInterrupt(uint32_t timeout);
+  void rearmInterrupt() { digitizer->rearmInterrupt(); }
   void reset() { digitizer->reset(); }
-  void initialize(DataWriter &dataWriter);
+  /* raw: pass the readout data on as Data::RawElement instead of decoding
+   * timeSlots: number of local-time epochs kept open for late events
+   * hugePages: back the data buffers with huge pages */
+  void initialize(DataWriter &dataWriter, size_t readoutBuffers = 0, bool raw = false,
+                  size_t timeSlots = DataHandler::defaultTimeSlots, bool hugePages = false);
 };
 
 #endif // JADAQ_DIGITIZER_HPP
@@ -0,0 +1,104 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Coincidence event building on the time ordered stream of hits from all
+ * digitizers. An event opens with a hit and takes every following hit within
+ * the coincidence window of it. Events with hits on fewer distinct channels
+ * than the multiplicity trigger are dropped, so a retrigger or pile-up on a
+ * single channel is no coincidence.
+ *
+ */
+
+#ifndef JADAQ_EVENTBUILDER_HPP
+#define JADAQ_EVENTBUILDER_HPP
+
+#include "DataFormat.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class EventBuilder {
+private:
+  uint64_t window;
+  size_t multiplicity;
+  std::vector<Data::HitElement> hits; // the open event
+  std::vector<uint64_t> channels;     // scratch for counting its channels
+  uint32_t eventNo = 0;
+  uint64_t events_ = 0;
+  uint64_t discarded_ = 0;
+
+  /* Distinct digitizer and channel pairs among the hits of the open event */
+  size_t distinctChannels() {
+    channels.clear();
+    for (const Data::HitElement &hit : hits) {
+      channels.push_back((uint64_t)hit.digitizerID << 16 | hit.channel);
+    }
+    std::sort(channels.begin(), channels.end());
+    return std::unique(channels.begin(), channels.end()) - channels.begin();
+  }
+
+public:
+  /* window: coincidence window in time tag units
+   * multiplicity: least number of distinct channels with hits in an event,
+   * 1 keeps every hit */
+  EventBuilder(uint64_t window_, size_t multiplicity_)
+      : window(window_), multiplicity(multiplicity_) {
+    hits.reserve(64);
+    channels.reserve(64);
+  }
+
+  /* Hits must come in time order, f is called with every element of the
+   * events that pass the trigger */
+  template <typename F> void push(const Data::HitElement &hit, F &f) {
+    if (!hits.empty() && (hit.time < hits.front().time ||
+                          hit.time - hits.front().time > window)) {
+      close(f);
+    }
+    hits.push_back(hit);
+  }
+
+  /* Close the open event */
+  template <typename F> void close(F &f) {
+    if (hits.empty()) {
+      return;
+    }
+    if (hits.size() >= multiplicity && (multiplicity <= 1 || distinctChannels() >= multiplicity)) {
+      Data::EventElement element;
+      element.event = eventNo++;
+      element.multiplicity = (uint16_t)std::min<size_t>(hits.size(), UINT16_MAX);
+      for (const Data::HitElement &hit : hits) {
+        element.hit = hit;
+        f(element);
+      }
+      events_ += 1;
+    } else {
+      discarded_ += hits.size();
+    }
+    hits.clear();
+  }
+
+  uint64_t events() const { return events_; }
+  /* Hits in events below the multiplicity trigger */
+  uint64_t discarded() const { return discarded_; }
+};
+
+#endif // JADAQ_EVENTBUILDER_HPP
@@ -28,6 +28,8 @@
 
 #include "Waveform.hpp"
 #include "caen.hpp"
+#include "columns.hpp"
+#include <algorithm>
 #include <iterator>
 #include <limits>
 
@@ -42,6 +44,7 @@ public:
     , ptr((uint32_t*)buffer.data) {}
   virtual uint16_t group() { return 0; }
   virtual void* end() const { return buffer.end(); }
+  const caen::ReadoutBuffer& block() const { return buffer; }
   virtual DataBlockBaseIterator& operator++() { return *this; }
   bool operator==(const DataBlockBaseIterator& other) const { return ptr == other.ptr; }
   bool operator!=(const DataBlockBaseIterator& other) const { return (ptr != other.ptr); }
@@ -68,8 +71,10 @@ public:
 /*
  * StdBLTEventIterator will iterate over a transferred block of events as used in the std FW of XX751.
  * Format is described on p53 in UM3350 - V1751/VX1751 User Manual rev. 16
+ * The concrete iterators are final so the decode loop in DataHandler, which
+ * is instantiated for each of them, calls them without virtual dispatch.
  */
-class StdBLTEventIterator : public DataBlockBaseIterator
+class StdBLTEventIterator final : public DataBlockBaseIterator
 {
 private:
   size_t eventSize;
@@ -103,6 +108,8 @@ public:
 
   uint32_t* getEventPtr() { return ptr; }
   size_t getEventSize() { return eventSize; };
+  template <typename T>
+  T event() { return T{ptr, eventSize}; }
 };
 
 
@@ -110,7 +117,7 @@ public:
  * DPPQDCEventIterator will iterate over a set of Board Aggregates contained in
  * one Data Block
  */
-  class DPPQDCEventIterator : public DataBlockBaseIterator{
+  class DPPQDCEventIterator final : public DataBlockBaseIterator{
 private:
   uint32_t *boardAggregateEnd;
   /*
@@ -120,7 +127,7 @@ private:
   class GroupIterator {
   private:
     uint32_t *ptr;
-    uint32_t *end;
+    uint32_t *end = nullptr;
     uint8_t groupMask = 0;
     size_t elementSize = 0;
     int group = -1;
@@ -205,6 +212,54 @@ private:
     size_t getEventSize() { return elementSize; };
     template <typename T>
     T event() { return T{ptr, elementSize}; }
+
+    /* Decode the remaining events of the current group aggregate into the
+     * free rows of out in one pass, as many as fit, and move past them.
+     * Returns the number of events decoded. */
+    size_t decode(jadaq::columns &out) {
+      size_t n = std::min((size_t)(end - ptr) / elementSize, out.available());
+      size_t first = out.size();
+      out.resize(first + n);
+      // Constant element sizes for the common list mode formats let the
+      // compiler unroll and vectorize the loop
+      if (elementSize == 2) {
+        decodeColumns<false>(ptr, n, 2, out, first);
+      } else if (elementSize == 3 && extras) {
+        decodeColumns<true>(ptr, n, 3, out, first);
+      } else if (extras) {
+        decodeColumns<true>(ptr, n, elementSize, out, first);
+      } else {
+        decodeColumns<false>(ptr, n, elementSize, out, first);
+      }
+      ptr += n * elementSize;
+      if (ptr == end) {
+        nextGroup();
+      }
+      return n;
+    }
+
+  private:
+    template <bool withExtras>
+    void decodeColumns(const uint32_t *p, size_t n, size_t es,
+                       jadaq::columns &out, size_t first) const {
+      uint64_t *time = out.time() + first;
+      uint16_t *channel = out.channel() + first;
+      uint16_t *charge = out.charge() + first;
+      uint16_t *baseline = out.baseline() + first;
+      const uint16_t groupBase = (uint16_t)(group << 3);
+      for (size_t i = 0; i < n; ++i, p += es) {
+        uint32_t last = p[es - 1];
+        time[i] = p[0];
+        channel[i] = groupBase | (uint16_t)(last >> 28);
+        charge[i] = (uint16_t)(last & 0x0000ffffu);
+        if (withExtras) {
+          time[i] |= ((uint64_t)(p[es - 2] & 0x0000ffffu)) << 32;
+          baseline[i] = (uint16_t)(p[es - 2] >> 16);
+        } else {
+          baseline[i] = 0;
+        }
+      }
+    }
   };
   GroupIterator groupIterator;
   GroupIterator nextGroupIterator() {
@@ -274,6 +329,22 @@ public:
     uint16_t group() { return groupIterator.currentGroup(); }
     uint32_t* getEventPtr() { return groupIterator.getEventPtr(); }
     size_t getEventSize() { return groupIterator.getEventSize(); };
+    template <typename T>
+    T event() { return groupIterator.event<T>(); }
+
+    /* Batch alternative to event(): decode the rest of the current group
+     * aggregate into out, time, channel, charge and (with extras) baseline
+     * as in ListElement422/ListElement8222. The group number of those rows is
+     * group() before the call. Stops early if out runs full, in which case the
+     * iterator stays in the same group. Returns the number of events decoded. */
+    size_t decodeGroup(jadaq::columns &out) {
+      size_t n = groupIterator.decode(out);
+      if (groupIterator == boardAggregateEnd) {
+        ptr = boardAggregateEnd;
+        groupIterator = nextGroupIterator();
+      }
+      return n;
+    }
 };
 
 template <>
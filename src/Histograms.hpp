@@ -0,0 +1,157 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Online per-channel histograms of the decoded data: charge, and optionally
+ * baseline and the time since the previous event on the channel. They are
+ * filled by the one thread decoding a digitizer, without locks or atomic
+ * read-modify-write, and can be copied out from any other thread at any time.
+ *
+ */
+
+#ifndef JADAQ_HISTOGRAMS_HPP
+#define JADAQ_HISTOGRAMS_HPP
+
+#include "DataFormat.hpp"
+#include "container.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+class Histograms {
+public:
+  enum Kind { Charge, Baseline, TimeDiff };
+  static constexpr const unsigned kinds = 3;
+  static constexpr const unsigned defaultBins = 4096;
+  /* Time differences are binned by their bit length, bin 0 holds 0 */
+  static constexpr const unsigned timeBins = 65;
+  static const char *name(Kind kind) {
+    static const char *names[] = {"charge", "baseline", "timediff"};
+    return names[kind];
+  }
+
+private:
+  typedef std::atomic<uint64_t> counter;
+  size_t channels_;
+  unsigned bins_;
+  unsigned shift; // from 16-bit value to bin
+  bool extras_;
+  size_t offset[kinds]; // of each kind within a channel
+  size_t stride;        // counters per channel, a whole number of cache lines
+  jadaq::slab storage;
+  counter *counters;
+  std::vector<uint64_t> lastTime; // per channel, for the time differences
+
+  /* Only ever written by one thread, so a plain load and store will do */
+  void count(size_t index) {
+    counter &c = counters[index];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  static unsigned bitLength(uint64_t v) { return v == 0 ? 0 : 64 - __builtin_clzll(v); }
+
+  template <typename L> void countTime(const L &element) {
+    uint64_t &last = lastTime[element.channel];
+    // Differences in the width of the time tag, so they survive a rollover
+    typename L::time_t diff = (typename L::time_t)(element.time - last);
+    if (last != 0) {
+      count(element.channel * stride + offset[TimeDiff] + bitLength(diff));
+    }
+    last = element.time;
+  }
+
+  static size_t layout(size_t bins, bool extras, size_t *offset) {
+    offset[Charge] = 0;
+    offset[Baseline] = bins;
+    offset[TimeDiff] = extras ? 2 * bins : bins;
+    size_t perChannel = offset[TimeDiff] + (extras ? timeBins : 0);
+    size_t perLine = jadaq::cacheLine / sizeof(counter);
+    return (perChannel + perLine - 1) / perLine * perLine;
+  }
+
+public:
+  /* bins: per histogram, a power of two up to 65536
+   * extras: also fill baseline and time difference histograms */
+  Histograms(size_t channels, unsigned bins = defaultBins, bool extras = false)
+      : channels_(channels), bins_(bins), shift(0), extras_(extras),
+        stride(layout(bins, extras, offset)),
+        storage(channels * stride * sizeof(counter), false),
+        counters(reinterpret_cast<counter *>(storage.data())),
+        lastTime(channels, 0) {
+    if (bins == 0 || bins > 65536 || (bins & (bins - 1)) != 0) {
+      throw std::invalid_argument("Histogram bins must be a power of two up to 65536");
+    }
+    while ((65536u >> shift) > bins) {
+      shift += 1;
+    }
+    for (size_t i = 0; i < channels * stride; ++i) {
+      new (&counters[i]) counter(0);
+    }
+  }
+  Histograms(const Histograms &) = delete;
+  Histograms &operator=(const Histograms &) = delete;
+
+  size_t channels() const { return channels_; }
+  bool extras() const { return extras_; }
+  unsigned bins(Kind kind) const { return kind == TimeDiff ? timeBins : bins_; }
+  /* Width of a charge or baseline bin */
+  unsigned binWidth() const { return 1u << shift; }
+
+  void fill(const Data::ListElement422 &element) {
+    if (element.channel >= channels_) {
+      return;
+    }
+    count(element.channel * stride + offset[Charge] + (element.charge >> shift));
+    if (extras_) {
+      countTime(element);
+    }
+  }
+  void fill(const Data::ListElement8222 &element) {
+    if (element.channel >= channels_) {
+      return;
+    }
+    size_t base = element.channel * stride;
+    count(base + offset[Charge] + (element.charge >> shift));
+    if (extras_) {
+      count(base + offset[Baseline] + (element.baseline >> shift));
+      countTime(element);
+    }
+  }
+  template <typename L> void fill(const Data::DPPQDCWaveformElement<L> &element) {
+    fill(element.listElement);
+  }
+  /* Elements without a charge */
+  template <typename E> void fill(const E &) {}
+
+  /* Copy of one histogram, safe to take while the histograms are filled. The
+   * counts are each exact at some point during the call. */
+  void snapshot(size_t channel, Kind kind, std::vector<uint64_t> &counts) const {
+    counts.resize(bins(kind));
+    const counter *c = counters + channel * stride + offset[kind];
+    for (size_t i = 0; i < counts.size(); ++i) {
+      counts[i] = c[i].load(std::memory_order_relaxed);
+    }
+  }
+};
+
+#endif // JADAQ_HISTOGRAMS_HPP
@@ -0,0 +1,72 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Adaptive poll interval for a single digitizer. Busy digitizers are polled
+ * more often so their internal memory does not overflow, while idle ones are
+ * polled less often to save link transactions.
+ *
+ */
+
+#ifndef JADAQ_POLLSCHEDULER_HPP
+#define JADAQ_POLLSCHEDULER_HPP
+
+#include "timer.h"
+#include <algorithm>
+#include <cstdint>
+
+class PollScheduler {
+private:
+  uint32_t minInterval; // microseconds
+  uint32_t maxInterval; // microseconds
+  uint32_t interval;    // microseconds
+  SteadyTimer timer;    // time since last poll
+
+public:
+  /* min defaults to the fixed 750 us grace period that worked around link
+   * hiccups with shorter intervals (issue #18) */
+  PollScheduler(uint32_t min = 750, uint32_t max = 10000, uint32_t initial = 750)
+      : minInterval(min), maxInterval(std::max(min, max)),
+        interval(std::min(std::max(initial, minInterval), maxInterval)) {}
+
+  /* Adapt the interval to the outcome of the readout just done:
+   * - nothing read: the digitizer is idle, so back off
+   * - the digitizer has more data ready, or the readout filled more than half
+   *   of the readout buffer: poll sooner
+   * - otherwise the interval is about right and is kept */
+  void update(uint32_t bytesRead, uint32_t bufferSize, bool moreReady) {
+    timer.reset();
+    if (bytesRead == 0) {
+      interval = std::min(maxInterval, interval + std::max(interval >> 1, 1u));
+    } else if (moreReady || bytesRead > (bufferSize >> 1)) {
+      interval = std::max(minInterval, interval >> 1);
+    }
+  }
+
+  /* Microseconds left until the digitizer should be polled again */
+  uint32_t remaining() const {
+    uint64_t elapsed = timer.elapsedus();
+    return elapsed >= interval ? 0 : (uint32_t)(interval - elapsed);
+  }
+
+  uint32_t current() const { return interval; }
+};
+
+#endif // JADAQ_POLLSCHEDULER_HPP
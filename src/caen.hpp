@@ -623,6 +623,19 @@ public:
     virtual bool trg_in() const { return (v & (1 << 16)) == (1 << 16); }
   };
 
+  /* helper class to translate Readout Status of register 0xEF04 */
+  class ReadoutStatus {
+  private:
+    uint32_t v;
+
+  public:
+    ReadoutStatus(uint32_t value) : v(value) {}
+    uint32_t value() const { return v; }
+    bool eventReady() const { return (v & (1 << 0)) == (1 << 0); }
+    bool outputBufferFull() const { return (v & (1 << 1)) == (1 << 1); }
+    bool busError() const { return (v & (1 << 2)) == (1 << 2); }
+  };
+
 
   /* Utility functions */
   void reset() { errorHandler(CAEN_DGTZ_Reset(handle_)); }
@@ -0,0 +1,90 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Struct-of-arrays storage for list mode events. Where jadaq::buffer holds
+ * packed ListElement records one after the other, columns holds one
+ * contiguous array per field so that sorting, filtering, histogramming and
+ * columnar output can work on whole arrays at a time.
+ *
+ */
+
+#ifndef JADAQ_COLUMNS_HPP
+#define JADAQ_COLUMNS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace jadaq {
+class columns {
+private:
+  static constexpr const size_t alignment = 64;
+  void *data_raw = nullptr;
+  size_t capacity_;
+  size_t size_ = 0;
+  uint64_t *time_;
+  uint16_t *channel_;
+  uint16_t *charge_;
+  uint16_t *baseline_;
+
+  static size_t aligned(size_t bytes) {
+    return (bytes + alignment - 1) & ~(alignment - 1);
+  }
+
+public:
+  /* Every column starts on its own cache line */
+  explicit columns(size_t capacity) : capacity_(capacity) {
+    size_t time_size = aligned(capacity * sizeof(uint64_t));
+    size_t column_size = aligned(capacity * sizeof(uint16_t));
+    if (posix_memalign(&data_raw, alignment, time_size + 3 * column_size) != 0) {
+      throw std::bad_alloc();
+    }
+    char *p = static_cast<char *>(data_raw);
+    time_ = reinterpret_cast<uint64_t *>(p);
+    channel_ = reinterpret_cast<uint16_t *>(p + time_size);
+    charge_ = reinterpret_cast<uint16_t *>(p + time_size + column_size);
+    baseline_ = reinterpret_cast<uint16_t *>(p + time_size + 2 * column_size);
+  }
+  columns(const columns &) = delete;
+  columns &operator=(const columns &) = delete;
+  ~columns() { free(data_raw); }
+
+  uint64_t *time() { return time_; }
+  uint16_t *channel() { return channel_; }
+  uint16_t *charge() { return charge_; }
+  uint16_t *baseline() { return baseline_; }
+  const uint64_t *time() const { return time_; }
+  const uint16_t *channel() const { return channel_; }
+  const uint16_t *charge() const { return charge_; }
+  const uint16_t *baseline() const { return baseline_; }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t available() const { return capacity_ - size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == capacity_; }
+  void clear() { size_ = 0; }
+  /* Grow or shrink the number of valid rows, n must not exceed capacity() */
+  void resize(size_t n) { size_ = n; }
+};
+} // namespace jadaq
+#endif // JADAQ_COLUMNS_HPP
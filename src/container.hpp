@@ -27,12 +27,75 @@
 #ifndef JADAQ_CONTAINER_HPP
 #define JADAQ_CONTAINER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 namespace jadaq {
+/* Buffer storage starts on a cache line */
+static constexpr const size_t cacheLine = 64;
+
+/* Memory mapped straight from the kernel for a number of buffers: page
+ * aligned and zero filled. Pages are only backed when first written, so they
+ * end up on the NUMA node of the thread filling the buffers rather than the
+ * one setting them up. With hugePages the slab is backed by huge pages if any
+ * are reserved, otherwise transparent huge pages are requested. */
+class slab {
+private:
+  static constexpr const size_t hugePageSize = 2 << 20;
+  char *data_;
+  size_t size_;
+
+  static size_t roundUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+  static void *map(size_t size, int flags) {
+    return mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  }
+
+public:
+  slab(size_t size, bool hugePages) {
+    void *p = MAP_FAILED;
+    if (hugePages) {
+      size_ = roundUp(size, hugePageSize);
+      p = map(size_, MAP_HUGETLB);
+    }
+    if (p == MAP_FAILED) {
+      size_ = roundUp(size, (size_t)sysconf(_SC_PAGESIZE));
+      p = map(size_, 0);
+      if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      if (hugePages) {
+        madvise(p, size_, MADV_HUGEPAGE);
+      }
+    }
+    data_ = static_cast<char *>(p);
+  }
+  slab(const slab &) = delete;
+  slab &operator=(const slab &) = delete;
+  ~slab() { munmap(data_, size_); }
+  char *data() { return data_; }
+  size_t size() const { return size_; }
+};
+
+template <typename T> class buffer_pool;
+
 template <typename T> class buffer {
 private:
+  friend class buffer_pool<T>;
+  buffer_pool<T> *pool = nullptr; // the pool the buffer belongs to, if any
+  mutable std::atomic<unsigned> refs{0};
+  bool const owner;       // data_raw is ours to free
   char *const data_raw;   // pointer to the raw allocated data
   char *const data_begin; // pointer to where we begin inserting elements
   char *const data_end;   // pointer to end of data
@@ -82,8 +145,22 @@ public:
   typedef iterator_<T> iterator;
   typedef iterator_<const T> const_iterator;
 
+  static char *allocate(size_t raw_size) {
+    void *p;
+    if (posix_memalign(&p, cacheLine, raw_size) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<char *>(memset(p, 0, raw_size));
+  }
+
   buffer(size_t raw_size, size_t object_size, size_t header_size)
-      : data_raw(new char[raw_size]), data_begin(data_raw + header_size),
+      : owner(true), data_raw(allocate(raw_size)), data_begin(data_raw + header_size),
+        data_end(data_raw + raw_size), element_size(object_size),
+        next(data_begin) {}
+
+  /* A buffer in storage owned by someone else, e.g. a slab */
+  buffer(char *storage, size_t raw_size, size_t object_size, size_t header_size)
+      : owner(false), data_raw(storage), data_begin(data_raw + header_size),
         data_end(data_raw + raw_size), element_size(object_size),
         next(data_begin) {}
 
@@ -102,11 +179,14 @@ public:
                          other.header_size());
   }
 
-  ~buffer() { delete[] data_raw; }
+  ~buffer() {
+    if (owner) {
+      free(data_raw);
+    }
+  }
 
   void push_back(const T &v) {
     check_length();
-    *next = v;
     memcpy(next, &v, element_size);
     next += element_size;
   }
@@ -116,8 +196,20 @@ public:
     next += element_size;
   }
 
+  /* Copy n elements stored back to back at src */
+  void append(const void *src, size_t n) {
+    if (next + element_size * n > data_end) {
+      throw std::length_error{"Out of storage space."};
+    }
+    memcpy(next, src, element_size * n);
+    next += element_size * n;
+  }
+
   void clear() { next = data_begin; }
 
+  /* The last element, the buffer must not be empty */
+  const T &back() const { return *reinterpret_cast<const T *>(next - element_size); }
+
   iterator begin() { return iterator{data_begin, element_size}; }
 
   const_iterator begin() const {
@@ -146,6 +238,9 @@ public:
 
   bool empty() const noexcept { return next == data_begin; }
 
+  /* True when one more element does not fit, i.e. emplace_back would throw */
+  bool full() const noexcept { return next + element_size > data_end; }
+
   void setElements(size_t n) { next = (data_begin + element_size * n); }
 
   void copy(const buffer<T> &other) {
@@ -157,6 +252,148 @@ public:
     copy(other);
     return *this;
   }
+
+  /* Pooled buffers are reference counted. A DataWriter that still needs a
+   * buffer after the call it was passed in takes a reference, and gives it
+   * back with release() when done. Returns false for buffers outside a pool,
+   * which must be used within the call. */
+  bool retain() const {
+    if (pool == nullptr) {
+      return false;
+    }
+    refs.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  void release() const;
 };
+
+/* A set of equally sized buffers that are handed out and returned, so that
+ * buffers are recycled rather than allocated. Buffers may be returned from
+ * another thread than the one acquiring them. Their storage is carved from
+ * slabs, each buffer starting on a cache line. */
+template <typename T> class buffer_pool {
+private:
+  size_t const raw_size;
+  size_t const object_size;
+  size_t const header_size;
+  size_t const stride; // raw_size rounded up to whole cache lines
+  bool const hugePages;
+  std::vector<slab *> slabs;
+  std::vector<buffer<T> *> buffers;   // all buffers owned by the pool
+  std::vector<buffer<T> *> available; // capacity for all, so release never allocates
+  std::mutex mutex;
+
+  /* Map a slab for n buffers and make them available */
+  void grow(size_t n) {
+    slab *s = new slab(n * stride, hugePages);
+    std::lock_guard<std::mutex> lock(mutex);
+    slabs.push_back(s);
+    available.reserve(buffers.size() + n);
+    for (size_t i = 0; i < n; ++i) {
+      buffer<T> *b = new buffer<T>(s->data() + i * stride, raw_size,
+                                   object_size, header_size);
+      b->pool = this;
+      buffers.push_back(b);
+      available.push_back(b);
+    }
+  }
+
+public:
+  /* Largest slab allocate() maps at a time */
+  static constexpr const size_t maxGrowth = 64 << 20;
+  /* How long the destructor waits for buffers still held elsewhere */
+  static constexpr const std::chrono::seconds releaseTimeout{10};
+
+  buffer_pool(size_t raw_size_, size_t object_size_, size_t header_size_,
+              bool hugePages_ = false)
+      : raw_size(raw_size_), object_size(object_size_),
+        header_size(header_size_),
+        stride((raw_size_ + cacheLine - 1) / cacheLine * cacheLine),
+        hugePages(hugePages_) {}
+  buffer_pool(const buffer_pool &) = delete;
+  buffer_pool &operator=(const buffer_pool &) = delete;
+  /* Buffers still held elsewhere, e.g. queued for a writer thread, are
+   * waited for up to releaseTimeout. Should any be held beyond that, the
+   * storage of all buffers is left mapped rather than pulled from under
+   * their holders. */
+  ~buffer_pool() {
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + releaseTimeout;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (available.size() < buffers.size()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        std::cerr << "ERROR: " << buffers.size() - available.size() << " of "
+                  << buffers.size() << " pooled buffers still in use after "
+                  << releaseTimeout.count() << " s - leaking them." << std::endl;
+        return;
+      }
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      lock.lock();
+    }
+    for (buffer<T> *b : buffers) {
+      delete b;
+    }
+    for (slab *s : slabs) {
+      delete s;
+    }
+  }
+
+  /* Add buffers to the pool and hand one out - the only operation that
+   * allocates besides reserve(). The pool grows in batches, doubling up to
+   * slabs of maxGrowth, so a run of allocations maps few slabs. */
+  buffer<T> *allocate() {
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex);
+      size_t n = std::min(std::max<size_t>(buffers.size(), 1),
+                          std::max<size_t>(maxGrowth / stride, 1));
+      lock.unlock();
+      grow(n);
+      buffer<T> *b = acquire();
+      // another thread may have taken the new buffers in between
+      if (b != nullptr) {
+        return b;
+      }
+    }
+  }
+
+  /* Hand out an empty buffer, or nullptr if all are in use */
+  buffer<T> *acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (available.empty()) {
+      return nullptr;
+    }
+    buffer<T> *b = available.back();
+    available.pop_back();
+    b->clear();
+    b->refs.store(1, std::memory_order_relaxed);
+    return b;
+  }
+
+  /* Drop a reference - the last one makes the buffer available again */
+  void release(buffer<T> *b) {
+    if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(mutex);
+      available.push_back(b);
+    }
+  }
+
+  /* Allocate n buffers up front, in one slab */
+  void reserve(size_t n) {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t missing = n > buffers.size() ? n - buffers.size() : 0;
+    lock.unlock();
+    if (missing > 0) {
+      grow(missing);
+    }
+  }
+};
+
+template <typename T> constexpr const size_t buffer_pool<T>::maxGrowth;
+template <typename T> constexpr const std::chrono::seconds buffer_pool<T>::releaseTimeout;
+
+template <typename T> void buffer<T>::release() const {
+  pool->release(const_cast<buffer<T> *>(this));
+}
 }
 #endif // JADAQ_CONTAINER_HPP
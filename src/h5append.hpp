@@ -0,0 +1,210 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * One dimensional, chunked HDF5 dataset of unlimited length that rows are
+ * appended to, and the storage settings of such datasets: chunk size and
+ * filter pipeline.
+ *
+ */
+
+#ifndef JADAQ_H5APPEND_HPP
+#define JADAQ_H5APPEND_HPP
+
+#include <H5Cpp.h>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace jadaq {
+/* Chunk size and filters of a dataset, unset values are left to the layout */
+class h5storage {
+public:
+  struct filter {
+    std::string name;
+    H5Z_filter_t id;
+    std::vector<unsigned> values; // parameters passed to the filter
+  };
+  /* Registered ids of the filters that come as plugins */
+  static constexpr const H5Z_filter_t lz4 = 32004;
+  static constexpr const H5Z_filter_t zstd = 32015;
+
+  size_t chunkBytes = 0; // 0: unset
+  bool filtersSet = false;
+  std::vector<filter> filters;
+
+  /* <number>[k|M|G] */
+  static size_t parseSize(const std::string &text) {
+    char *end;
+    unsigned long long size = strtoull(text.c_str(), &end, 10);
+    std::string unit(end);
+    if (end == text.c_str() || unit.size() > 1) {
+      throw std::invalid_argument("Invalid size: \"" + text + "\"");
+    }
+    if (unit == "k") {
+      size <<= 10;
+    } else if (unit == "M") {
+      size <<= 20;
+    } else if (unit == "G") {
+      size <<= 30;
+    } else if (!unit.empty()) {
+      throw std::invalid_argument("Invalid size: \"" + text + "\"");
+    }
+    return size;
+  }
+
+  /* <name>[:<level>] with name one of shuffle, deflate, lz4 and zstd */
+  static filter parseFilter(const std::string &text) {
+    size_t colon = text.find(':');
+    std::string name = text.substr(0, colon);
+    filter f{name, H5Z_FILTER_NONE, {}};
+    int level = -1;
+    if (colon != std::string::npos) {
+      level = atoi(text.c_str() + colon + 1);
+    }
+    if (name == "shuffle") {
+      f.id = H5Z_FILTER_SHUFFLE;
+    } else if (name == "deflate") {
+      f.id = H5Z_FILTER_DEFLATE;
+      f.values.push_back(level < 0 ? 4 : level);
+    } else if (name == "lz4") {
+      f.id = lz4;
+    } else if (name == "zstd") {
+      f.id = zstd;
+      if (level >= 0) {
+        f.values.push_back(level);
+      }
+    } else {
+      throw std::invalid_argument("Unknown HDF5 filter: \"" + name + "\"");
+    }
+    if (H5Zfilter_avail(f.id) <= 0) {
+      throw std::invalid_argument("HDF5 filter \"" + name +
+                                  "\" is not available - is the plugin in HDF5_PLUGIN_PATH?");
+    }
+    return f;
+  }
+
+  /* Comma separated filters applied in order, or none */
+  void setFilters(const std::string &text) {
+    filters.clear();
+    filtersSet = true;
+    if (text == "none") {
+      return;
+    }
+    size_t begin = 0;
+    while (begin <= text.size()) {
+      size_t end = std::min(text.find(',', begin), text.size());
+      filters.push_back(parseFilter(text.substr(begin, end - begin)));
+      begin = end + 1;
+    }
+  }
+
+  /* Settings of other on top of these */
+  void merge(const h5storage &other) {
+    if (other.chunkBytes > 0) {
+      chunkBytes = other.chunkBytes;
+    }
+    if (other.filtersSet) {
+      filtersSet = true;
+      filters = other.filters;
+    }
+  }
+
+  bool compressed() const { return !filters.empty(); }
+
+  /* Rows of rowBytes each in a chunk, defaultBytes if unset */
+  hsize_t chunkRows(size_t rowBytes, size_t defaultBytes) const {
+    size_t bytes = chunkBytes > 0 ? chunkBytes : defaultBytes;
+    return std::max<hsize_t>(bytes / rowBytes, 1);
+  }
+
+  H5::DSetCreatPropList createList(hsize_t chunkRows) const {
+    H5::DSetCreatPropList plist;
+    plist.setChunk(1, &chunkRows);
+    for (const filter &f : filters) {
+      plist.setFilter(f.id, H5Z_FLAG_MANDATORY, f.values.size(),
+                      f.values.empty() ? nullptr : f.values.data());
+    }
+    return plist;
+  }
+};
+
+class h5append {
+private:
+  H5::DataSet dataset;
+  H5::DataType type;
+  hsize_t rows = 0;
+  hsize_t chunk;
+
+public:
+  /* Hash slots of the chunk cache, a prime */
+  static constexpr const size_t cacheSlots = 12421;
+
+  /* chunkRows: rows per chunk, the unit HDF5 stores and compresses
+   * cacheBytes: chunk cache, 0 for the file's. A partly filled chunk that
+   * does not fit is written and read back for every append, which with
+   * filters means compressing it over and over. */
+  h5append(const H5::Group &group, const std::string &name,
+           const H5::DataType &type_, hsize_t chunkRows,
+           const h5storage &storage = h5storage(), size_t cacheBytes = 0)
+      : type(type_), chunk(std::max<hsize_t>(chunkRows, 1)) {
+    hsize_t dims[1] = {0};
+    hsize_t maxDims[1] = {H5S_UNLIMITED};
+    H5::DataSpace space(1, dims, maxDims);
+    H5::DSetAccPropList access;
+    if (cacheBytes > 0) {
+      // Chunks are written once, so evict fully written ones first
+      access.setChunkCache(cacheSlots, cacheBytes, 1.0);
+    }
+    dataset = group.createDataSet(name, type, space, storage.createList(chunk), access);
+  }
+  h5append(const h5append &) = delete;
+  h5append &operator=(const h5append &) = delete;
+
+  /* Append n rows stored back to back at data */
+  void append(const void *data, hsize_t n) {
+    if (n == 0) {
+      return;
+    }
+    hsize_t size[1] = {rows + n};
+    dataset.extend(size);
+    H5::DataSpace space = dataset.getSpace();
+    hsize_t offset[1] = {rows};
+    hsize_t count[1] = {n};
+    space.selectHyperslab(H5S_SELECT_SET, count, offset);
+    H5::DataSpace memory(1, count);
+    dataset.write(data, type, memory, space);
+    rows += n;
+  }
+
+  /* Write what is cached to the file, for readers in SWMR mode */
+  void flush() {
+    if (H5Dflush(dataset.getId()) < 0) {
+      throw H5::DataSetIException("h5append::flush", "H5Dflush failed");
+    }
+  }
+
+  hsize_t size() const { return rows; }
+  hsize_t chunkRows() const { return chunk; }
+};
+} // namespace jadaq
+#endif // JADAQ_H5APPEND_HPP
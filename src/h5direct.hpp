@@ -0,0 +1,233 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Appending to an HDF5 dataset in whole chunks, filtered on a pool of worker
+ * threads and written as they are with H5Dwrite_chunk. The library then only
+ * stores the bytes, so filtering scales with the workers instead of running
+ * inside the library, one chunk at a time. The filters are applied here, so
+ * only shuffle and deflate are supported.
+ *
+ */
+
+#ifndef JADAQ_H5DIRECT_HPP
+#define JADAQ_H5DIRECT_HPP
+
+#include "h5append.hpp"
+#include "parallel.hpp"
+#include <H5Cpp.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace jadaq {
+class h5direct {
+private:
+  struct chunk {
+    hsize_t index;
+    std::vector<char> raw;
+    std::vector<char> filtered;
+    uint32_t mask = 0; // filters skipped, bit i for filter i
+    bool done = false;
+  };
+
+  H5::DataSet dataset;
+  size_t rowBytes;
+  hsize_t chunk_;
+  std::vector<h5storage::filter> filters;
+  task_pool &pool;
+  size_t maxQueued; // chunks being filtered or waiting to be written
+  std::unique_ptr<chunk> filling;
+  std::deque<std::unique_ptr<chunk> > queued; // in chunk order
+  std::vector<std::unique_ptr<chunk> > spare;
+  std::mutex mutex; // guards done
+  std::condition_variable finished;
+  hsize_t rows = 0;
+  hsize_t written = 0; // rows in chunks handed to the library
+
+  static void shuffle(const char *in, char *out, size_t elementSize, size_t n) {
+    for (size_t byte = 0; byte < elementSize; ++byte) {
+      for (size_t i = 0; i < n; ++i) {
+        out[byte * n + i] = in[i * elementSize + byte];
+      }
+    }
+  }
+
+  /* Runs on a worker. Filters that do not pay off are skipped, like the
+   * library does for deflate. */
+  void filter(chunk &c) {
+    std::vector<char> scratch;
+    const char *data = c.raw.data();
+    size_t size = c.raw.size();
+    for (size_t i = 0; i < filters.size(); ++i) {
+      std::vector<char> &out = data == c.filtered.data() ? scratch : c.filtered;
+      if (filters[i].id == H5Z_FILTER_SHUFFLE) {
+        out.resize(size);
+        shuffle(data, out.data(), rowBytes, size / rowBytes);
+      } else {
+        uLongf length = compressBound(size);
+        out.resize(length);
+        if (compress2(reinterpret_cast<Bytef *>(out.data()), &length,
+                      reinterpret_cast<const Bytef *>(data), size,
+                      filters[i].values[0]) != Z_OK ||
+            length >= size) {
+          c.mask |= 1u << i;
+          continue;
+        }
+        out.resize(length);
+      }
+      data = out.data();
+      size = out.size();
+    }
+    if (data != c.filtered.data()) {
+      c.filtered.assign(data, data + size);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    c.done = true;
+    finished.notify_all();
+  }
+
+  void submit() {
+    chunk *c = filling.release();
+    queued.emplace_back(c);
+    pool.submit([this, c]() { filter(*c); });
+  }
+
+  void startChunk() {
+    if (spare.empty()) {
+      filling.reset(new chunk);
+      filling->raw.resize(chunk_ * rowBytes);
+    } else {
+      filling = std::move(spare.back());
+      spare.pop_back();
+      filling->mask = 0;
+      filling->done = false;
+    }
+    filling->index = rows / chunk_;
+  }
+
+  /* Write the filtered chunks in order, waiting for at most all - limit of
+   * them to get through the workers */
+  void write(size_t limit) {
+    while (!queued.empty()) {
+      chunk &c = *queued.front();
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!c.done && queued.size() <= limit) {
+          return;
+        }
+        finished.wait(lock, [&c]() { return c.done; });
+      }
+      hsize_t end = std::min(rows, (c.index + 1) * chunk_);
+      hsize_t dims[1] = {end};
+      dataset.extend(dims);
+      hsize_t offset[1] = {c.index * chunk_};
+      if (H5Dwrite_chunk(dataset.getId(), H5P_DEFAULT, c.mask, offset,
+                         c.filtered.size(), c.filtered.data()) < 0) {
+        throw H5::DataSetIException("h5direct::write", "H5Dwrite_chunk failed");
+      }
+      written = end;
+      spare.push_back(std::move(queued.front()));
+      queued.pop_front();
+    }
+  }
+
+public:
+  /* Throws std::invalid_argument unless the filters are ones applied here */
+  static void check(const h5storage &storage) {
+    for (const h5storage::filter &f : storage.filters) {
+      if (f.id != H5Z_FILTER_SHUFFLE && f.id != H5Z_FILTER_DEFLATE) {
+        throw std::invalid_argument("HDF5 filter \"" + f.name +
+                                    "\" can not be used with direct chunk writes");
+      }
+    }
+  }
+
+  /* storage: filters must be shuffle and deflate only
+   * workers: pool the filtering runs on, shared between datasets */
+  h5direct(const H5::Group &group, const std::string &name,
+           const H5::DataType &type, hsize_t chunkRows, const h5storage &storage,
+           task_pool &workers)
+      : rowBytes(type.getSize()), chunk_(std::max<hsize_t>(chunkRows, 1)),
+        filters(storage.filters), pool(workers), maxQueued(2 * workers.size() + 2) {
+    check(storage);
+    hsize_t dims[1] = {0};
+    hsize_t maxDims[1] = {H5S_UNLIMITED};
+    H5::DataSpace space(1, dims, maxDims);
+    dataset = group.createDataSet(name, type, space, storage.createList(chunk_));
+    startChunk();
+  }
+  h5direct(const h5direct &) = delete;
+  h5direct &operator=(const h5direct &) = delete;
+  ~h5direct() { close(); }
+
+  /* Append n rows stored back to back at data. Only whole chunks are
+   * written, the rest waits for more rows or close(). */
+  void append(const void *data, hsize_t n) {
+    const char *p = static_cast<const char *>(data);
+    while (n > 0) {
+      hsize_t offset = rows % chunk_;
+      hsize_t count = std::min(n, chunk_ - offset);
+      memcpy(filling->raw.data() + offset * rowBytes, p, count * rowBytes);
+      rows += count;
+      p += count * rowBytes;
+      n -= count;
+      if (rows % chunk_ == 0) {
+        submit();
+        write(maxQueued);
+        startChunk();
+      }
+    }
+    write(maxQueued);
+  }
+
+  /* Write everything, the last chunk padded with zeros */
+  void close() {
+    if (filling && rows % chunk_ != 0) {
+      hsize_t offset = rows % chunk_;
+      memset(filling->raw.data() + offset * rowBytes, 0, (chunk_ - offset) * rowBytes);
+      submit();
+    }
+    filling.reset();
+    write(0);
+  }
+
+  /* Write the whole chunks and what is cached to the file, for readers in
+   * SWMR mode. Rows still being collected into a chunk are not part of it. */
+  void flush() {
+    write(0);
+    if (H5Dflush(dataset.getId()) < 0) {
+      throw H5::DataSetIException("h5direct::flush", "H5Dflush failed");
+    }
+  }
+
+  hsize_t size() const { return rows; }
+  /* Rows readers can see */
+  hsize_t visible() const { return written; }
+  hsize_t chunkRows() const { return chunk_; }
+};
+} // namespace jadaq
+#endif // JADAQ_H5DIRECT_HPP
@@ -28,14 +28,26 @@
 #include "DataHandler.hpp"
 #include "DataWriter.hpp"
 #include "DataWriterHDF5.hpp"
+#include "DataWriterAsync.hpp"
+#include "DataWriterFanout.hpp"
+#include "DataWriterMerge.hpp"
 #include "DataWriterNetwork.hpp"
 #include "DataWriterText.hpp"
 #include "Digitizer.hpp"
+#include "Histograms.hpp"
 //#include "Timer.hpp"
 #include "interrupt.hpp"
+#include "parallel.hpp"
 #include <boost/program_options.hpp>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <pthread.h>
 #include <queue>
 #include <thread>
 #include "runno.hpp"
@@ -52,8 +64,28 @@ namespace po = boost::program_options;
 struct {
   bool textout = false;
   bool hdf5out = false;
+  DataWriterHDF5::Options hdf5;
   float split = -1.0f;
   bool nullout = false;
+  bool threaded = false;
+  bool raw = false;
+  bool hugePages = false;
+  int timeSlots = DataHandler::defaultTimeSlots;
+  bool merge = false;
+  uint64_t mergeWindow = 62500000; // time tag units, 1 s at 16 ns
+  uint64_t coincidence = 0; // time tag units, 0: no event building
+  int multiplicity = 1;
+  int writerQueue = 0; // buffers, 0: write in the calling thread
+  DataWriterAsync::Policy queuePolicy = DataWriterAsync::Block;
+  std::string *histogramFile = nullptr;
+  int histogramBins = Histograms::defaultBins;
+  bool histogramExtras = false;
+  uint32_t histogramInterval = 10; // seconds
+  int readoutBuffers = 0;
+  int interruptAggregates = 0;
+  uint32_t interruptTimeout = 100; // milliseconds
+  uint32_t pollMin = 750; // microseconds, the grace period of issue #18
+  uint32_t pollMax = 10000; // microseconds
   long events = -1;
   uint32_t time = 0xffffff; // many seconds
   uint32_t stats = 0xffffff; // many seconds
@@ -67,10 +99,23 @@ struct {
 } conf;
 
 struct {
-  bool timeout{false};
+  std::atomic<bool> timeout{false};
+  std::atomic<bool> stop{false}; // tells readout and service threads to finish
   std::vector<Digitizer> * digarr;
+  const DataWriterMerge * merger = nullptr;
+  std::vector<std::pair<std::string, const DataWriterAsync::Stats *> > queues;
 } application_control;
 
+/* Run control state for a digitizer read out in its own thread */
+struct ReadoutWorker {
+  Digitizer &digitizer;
+  std::atomic<bool> failed{false};
+  std::atomic<bool> readoutDone{false};
+  std::thread thread;
+  std::thread decoder; // only used with a pool of readout buffers
+  explicit ReadoutWorker(Digitizer &digitizer_) : digitizer(digitizer_) {}
+};
+
 static void printStats(const std::vector<Digitizer> &digitizers, uint32_t elapsedms, uint64_t time) {
   static uint64_t oldevents=0;
   static uint64_t oldbytes=0;
@@ -79,18 +124,36 @@ static void printStats(const std::vector<Digitizer> &digitizers, uint32_t elapse
   uint64_t bytesRead = 0;
   uint64_t readouts = 0;
   printf("  Status after %ld seconds runtime:\n", time/1000);
-  printf("   DIGITIZER                        Events                  Bytes                       Readouts\n");
+  printf("   DIGITIZER                        Events                  Bytes                       Readouts      Poll(us)      Packages   Buffers         Late    Misordered\n");
   for (const Digitizer &digitizer : digitizers) {
     const Digitizer::Stats &stats = digitizer.getStats();
-    printf("     %-10s: %6s    %15" PRIu64 "           %15" PRIu64 "           %15" PRIu64 "\n",
+    const DataHandler::Stats &handlerStats = digitizer.getHandlerStats();
+    printf("     %-10s: %6s    %15" PRIu64 "           %15" PRIu64 "           %15" PRIu64 "    %10u    %10" PRIu64 "    %6" PRIu64 "   %10" PRIu64 "    %10" PRIu64 "\n",
            digitizer.name().c_str(), digitizer.active ? "ALIVE!" : "DEAD!",
-           stats.eventsFound, stats.bytesRead, stats.readouts);
+           stats.eventsFound.load(), stats.bytesRead.load(), stats.readouts.load(),
+           stats.pollInterval.load(), handlerStats.handoffs.load(), handlerStats.allocations.load(),
+           handlerStats.late.load(), handlerStats.misordered.load());
     eventsFound += stats.eventsFound;
     bytesRead += stats.bytesRead;
     readouts += stats.readouts;
   }
   printf("     Total                 %15" PRIu64 "           %15" PRIu64 "           %15" PRIu64"\n",
          eventsFound, bytesRead, readouts);
+  if (application_control.merger != nullptr) {
+    const DataWriterMerge::Stats &mergeStats = application_control.merger->stats();
+    printf("     Merged                %15" PRIu64 " hits      %15" PRIu64 " late      %15" PRIu64 " pending\n",
+           mergeStats.hits.load(), mergeStats.late.load(), mergeStats.pending.load());
+    if (conf.coincidence > 0) {
+      printf("     Coincidences          %15" PRIu64 " events    %15" PRIu64 " discarded\n",
+             mergeStats.events.load(), mergeStats.discarded.load());
+    }
+  }
+  for (const auto &queue : application_control.queues) {
+    const DataWriterAsync::Stats &writerStats = *queue.second;
+    printf("     %-10s queue      %15" PRIu64 " depth     %15" PRIu64 " high      %15" PRIu64 " blocked   %15" PRIu64 " dropped   %15" PRIu64 " spilled\n",
+           queue.first.c_str(), writerStats.depth.load(), writerStats.highWater.load(),
+           writerStats.blocked.load(), writerStats.dropped.load(), writerStats.spilled.load());
+  }
   printf("     Total Rates           %15ld/s         %15ld/s         %15ld/s\n\n",
          (eventsFound - oldevents)*1000/elapsedms,
          (bytesRead - oldbytes)*1000/elapsedms,
@@ -103,12 +166,114 @@ static void printStats(const std::vector<Digitizer> &digitizers, uint32_t elapse
 
 
 
+/* Keep reading out a single digitizer until told to stop by run control */
+static void readout_thread(ReadoutWorker &worker) {
+  Digitizer &digitizer = worker.digitizer;
+  XTRACE(MAIN, INF, "Starting readout thread for digitizer %s", digitizer.name().c_str());
+  if (digitizer.core >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(digitizer.core, &cpuset);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (rc != 0) {
+      XTRACE(MAIN, WAR, "Unable to pin readout thread for %s to core %d (%d)",
+             digitizer.name().c_str(), digitizer.core, rc);
+    }
+  }
+  while (!application_control.stop) {
+    try {
+      /* With interrupts we read out when the digitizer has enough aggregates
+       * ready, or when the timeout expires so low rate data is not kept
+       * on the digitizer indefinitely */
+      bool interrupted = false;
+      if (digitizer.interruptEnabled()) {
+        interrupted = digitizer.waitForInterrupt(conf.interruptTimeout);
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(digitizer.pollRemaining()));
+      }
+      if (conf.readoutBuffers > 0) {
+        if (!digitizer.readout()) {
+          // the decoder is behind - give it a chance to catch up
+          std::this_thread::sleep_for(std::chrono::microseconds(conf.pollMin));
+        }
+      } else {
+        digitizer.acquisition();
+      }
+      if (interrupted) {
+        digitizer.rearmInterrupt();
+      }
+    } catch (caen::Error &e) {
+      XTRACE(MAIN, ERR, "ERROR: unexpected exception during acquisition: %s (%d)", e.what(), e.code());
+      worker.failed = true;
+      break;
+    }
+  }
+  worker.readoutDone = true;
+}
+
+/* Decode the buffers filled by the readout thread of a single digitizer */
+static void decoder_thread(ReadoutWorker &worker) {
+  Digitizer &digitizer = worker.digitizer;
+  XTRACE(MAIN, INF, "Starting decoder thread for digitizer %s", digitizer.name().c_str());
+  while (true) {
+    if (!digitizer.decode()) {
+      // Only quit when the readout thread is done and everything is decoded
+      if (worker.readoutDone && !digitizer.decode()) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+}
+
+/* Snapshot of the online histograms of all digitizers. The file is replaced
+ * in one go, so a reader never sees it half written. */
+static void writeHistograms(const std::vector<Digitizer> &digitizers, const std::string &file) {
+  std::string tmp = file + ".tmp";
+  std::ofstream out(tmp);
+  if (!out) {
+    XTRACE(MAIN, ERR, "Unable to open histogram file %s", tmp.c_str());
+    return;
+  }
+  out << "# digitizer histogram channel counts..." << std::endl;
+  std::vector<uint64_t> counts;
+  for (const Digitizer &digitizer : digitizers) {
+    const Histograms *histograms = digitizer.getHistograms();
+    if (histograms == nullptr) {
+      continue;
+    }
+    out << "# " << digitizer.name() << " bin width " << histograms->binWidth() << std::endl;
+    for (unsigned k = 0; k < Histograms::kinds; ++k) {
+      Histograms::Kind kind = (Histograms::Kind)k;
+      if (kind != Histograms::Charge && !histograms->extras()) {
+        continue;
+      }
+      for (size_t channel = 0; channel < histograms->channels(); ++channel) {
+        histograms->snapshot(channel, kind, counts);
+        if (std::all_of(counts.begin(), counts.end(), [](uint64_t c) { return c == 0; })) {
+          continue;
+        }
+        out << digitizer.name() << " " << Histograms::name(kind) << " " << channel;
+        for (uint64_t c : counts) {
+          out << " " << c;
+        }
+        out << "\n";
+      }
+    }
+  }
+  out.close();
+  if (std::rename(tmp.c_str(), file.c_str()) != 0) {
+    XTRACE(MAIN, ERR, "Unable to replace histogram file %s", file.c_str());
+  }
+}
+
 void service_thread() {
   XTRACE(MAIN, INF, "Starting service thread");
   SteadyTimer stoptimer;
   SteadyTimer stattimer;
+  SteadyTimer histogramTimer;
 
-  while (1) {
+  while (!application_control.stop) {
     if (stoptimer.elapsedms() >= (uint64_t) conf.time * 1e3) {
       application_control.timeout = true;
       return;
@@ -118,6 +283,11 @@ void service_thread() {
       printStats(*application_control.digarr, stattimer.elapsedus()/1000, stoptimer.elapsedms());
       stattimer.reset();
     }
+    if (conf.histogramFile != nullptr &&
+        histogramTimer.elapsedms() >= (uint64_t) conf.histogramInterval * 1e3) {
+      writeHistograms(*application_control.digarr, *conf.histogramFile);
+      histogramTimer.reset();
+    }
     usleep(5000);
   }
 
@@ -138,6 +308,58 @@ int main(int argc, const char *argv[]) {
        ("split,s", po::value<float>()->value_name("<seconds>")->default_value(conf.split),
         "Split output file every <seconds> seconds")
        ("hdf5,H", po::bool_switch(&conf.hdf5out), "Output to hdf5 file.")
+       ("hdf5-layout", po::value<std::string>()->value_name("<layout>")->default_value("tables"),
+        "Layout of the HDF5 file: tables (one per time stamp), appended (one dataset per digitizer) or columns (appended, with list mode fields in datasets of their own)")
+       ("hdf5-chunk", po::value<std::vector<std::string>>()->value_name("[<kind>=]<bytes>"),
+        "HDF5 chunk size, for all data or one kind: list, waveform, standard, raw, hit or event")
+       ("hdf5-filters", po::value<std::vector<std::string>>()->value_name("[<kind>=]<filters>"),
+        "HDF5 filters, e.g. shuffle,deflate:4 - also lz4 and zstd[:<level>] if the plugins are installed")
+       ("hdf5-cache", po::value<std::string>()->value_name("<bytes>"),
+        "HDF5 chunk cache per dataset")
+       ("hdf5-workers", po::value<int>()->value_name("<count>")->default_value(0),
+        "Threads compressing HDF5 chunks, not with the tables layout, 0: HDF5 compresses them")
+       ("hdf5-swmr", po::bool_switch(&conf.hdf5.swmr),
+        "Let readers follow the HDF5 file while it is written (SWMR), not with the tables layout")
+       ("hdf5-flush", po::value<int>()->value_name("<ms>")->default_value(conf.hdf5.flushInterval),
+        "Pass data on and flush the HDF5 file for SWMR readers every <ms> milliseconds")
+       ("threads,T", po::bool_switch(&conf.threaded),
+        "Read out each digitizer in its own thread.")
+       ("raw", po::bool_switch(&conf.raw),
+        "Pass the data read from the digitizers on without decoding it.")
+       ("huge-pages", po::bool_switch(&conf.hugePages),
+        "Back the data buffers with huge pages.")
+       ("time-slots", po::value<int>()->value_name("<count>")->default_value(conf.timeSlots),
+        "Keep <count> local time windows per digitizer open for late events (minimum 2)")
+       ("merge", po::bool_switch(&conf.merge),
+        "Merge the list mode data from all digitizers into one time ordered stream.")
+       ("merge-window", po::value<uint64_t>()->value_name("<ticks>")->default_value(conf.mergeWindow),
+        "Hold merged events back for at most <ticks> time tag units waiting for earlier ones")
+       ("coincidence", po::value<uint64_t>()->value_name("<ticks>")->default_value(conf.coincidence),
+        "Group merged events within <ticks> time tag units of the first into coincidence events (implies --merge)")
+       ("multiplicity", po::value<int>()->value_name("<channels>")->default_value(conf.multiplicity),
+        "Discard coincidence events with hits on fewer than <channels> distinct channels - 2 discards singles")
+       ("writer-queue", po::value<int>()->value_name("<buffers>")->default_value(conf.writerQueue),
+        "Write data in a thread of its own, queueing up to <buffers> filled buffers for it")
+       ("queue-policy", po::value<std::string>()->value_name("<policy>")->default_value("block"),
+        "What to do with a buffer when the writer queue is full: block, drop or spill")
+       ("histograms", po::value<std::string>()->value_name("<file>"),
+        "Keep per-channel charge histograms and write them to <file> regularly")
+       ("histogram-bins", po::value<int>()->value_name("<bins>")->default_value(conf.histogramBins),
+        "Number of bins of the charge histograms - a power of two up to 65536")
+       ("histogram-extras", po::bool_switch(&conf.histogramExtras),
+        "Also keep baseline and time difference histograms")
+       ("histogram-interval", po::value<int>()->value_name("<seconds>")->default_value(conf.histogramInterval),
+        "Write the histograms every <seconds> seconds")
+       ("readout-buffers,R", po::value<int>()->value_name("<count>")->default_value(conf.readoutBuffers),
+        "Decode data in a separate thread using a pool of <count> readout buffers per digitizer (requires --threads)")
+       ("interrupt,I", po::value<int>()->value_name("<aggregates>")->default_value(conf.interruptAggregates),
+        "Wait for an interrupt when <aggregates> aggregates are ready instead of polling digitizers on optical links (requires --threads)")
+       ("interrupt-timeout", po::value<int>()->value_name("<ms>")->default_value(conf.interruptTimeout),
+        "Read out anyway if no interrupt arrived within <ms> milliseconds")
+       ("poll-min", po::value<int>()->value_name("<us>")->default_value(conf.pollMin),
+        "Shortest interval between polling a digitizer for data")
+       ("poll-max", po::value<int>()->value_name("<us>")->default_value(conf.pollMax),
+        "Longest interval between polling a digitizer for data")
        ("stats",  po::value<int>()->value_name("<seconds>")->default_value(conf.stats),
         "Print statistics every <seconds> seconds")
        ("path,p", po::value<std::string>()->value_name("<path>")->default_value("."),
@@ -190,6 +412,77 @@ int main(int argc, const char *argv[]) {
     conf.time = vm["time"].as<int>();
     conf.split = vm["split"].as<float>();
     conf.stats = vm["stats"].as<int>();
+    conf.readoutBuffers = vm["readout-buffers"].as<int>();
+    conf.timeSlots = vm["time-slots"].as<int>();
+    conf.mergeWindow = vm["merge-window"].as<uint64_t>();
+    conf.coincidence = vm["coincidence"].as<uint64_t>();
+    conf.multiplicity = vm["multiplicity"].as<int>();
+    if (conf.coincidence > 0) {
+      conf.merge = true;
+    }
+    if (conf.multiplicity < 1) {
+      std::cerr << "--multiplicity must be at least 1" << std::endl;
+      return -1;
+    }
+    if (vm.count("histograms")) {
+      conf.histogramFile = new std::string(vm["histograms"].as<std::string>());
+    }
+    conf.histogramBins = vm["histogram-bins"].as<int>();
+    conf.histogramInterval = vm["histogram-interval"].as<int>();
+    if (conf.histogramBins < 1 || conf.histogramBins > 65536 ||
+        (conf.histogramBins & (conf.histogramBins - 1)) != 0) {
+      std::cerr << "--histogram-bins must be a power of two up to 65536" << std::endl;
+      return -1;
+    }
+    conf.writerQueue = vm["writer-queue"].as<int>();
+    try {
+      conf.hdf5.layout = DataWriterHDF5::layout(vm["hdf5-layout"].as<std::string>());
+      if (vm.count("hdf5-chunk")) {
+        for (std::string spec : vm["hdf5-chunk"].as<std::vector<std::string>>()) {
+          conf.hdf5.storageFor(spec).chunkBytes = jadaq::h5storage::parseSize(spec);
+        }
+      }
+      if (vm.count("hdf5-filters")) {
+        for (std::string spec : vm["hdf5-filters"].as<std::vector<std::string>>()) {
+          conf.hdf5.storageFor(spec).setFilters(spec);
+        }
+      }
+      if (vm.count("hdf5-cache")) {
+        conf.hdf5.cacheBytes = jadaq::h5storage::parseSize(vm["hdf5-cache"].as<std::string>());
+      }
+      if (vm["hdf5-workers"].as<int>() > 0) {
+        if (conf.hdf5.layout == DataWriterHDF5::Tables) {
+          throw std::invalid_argument("--hdf5-workers requires --hdf5-layout appended or columns");
+        }
+        conf.hdf5.workers = vm["hdf5-workers"].as<int>();
+        for (const auto &itr : conf.hdf5.storage) {
+          jadaq::h5direct::check(itr.second);
+        }
+      }
+      if (conf.hdf5.swmr && conf.hdf5.layout == DataWriterHDF5::Tables) {
+        throw std::invalid_argument("--hdf5-swmr requires --hdf5-layout appended or columns");
+      }
+      if (vm["hdf5-flush"].as<int>() < 1) {
+        throw std::invalid_argument("--hdf5-flush must be at least 1 ms");
+      }
+      conf.hdf5.flushInterval = vm["hdf5-flush"].as<int>();
+      conf.queuePolicy = DataWriterAsync::policy(vm["queue-policy"].as<std::string>());
+    } catch (std::invalid_argument &e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+    if (conf.readoutBuffers > 0 && !conf.threaded) {
+      std::cerr << "--readout-buffers requires --threads" << std::endl;
+      return -1;
+    }
+    conf.interruptAggregates = vm["interrupt"].as<int>();
+    conf.interruptTimeout = vm["interrupt-timeout"].as<int>();
+    conf.pollMin = vm["poll-min"].as<int>();
+    conf.pollMax = vm["poll-max"].as<int>();
+    if (conf.interruptAggregates > 0 && !conf.threaded) {
+      std::cerr << "--interrupt requires --threads" << std::endl;
+      return -1;
+    }
 
     if (vm.count("network")) {
       conf.network = new std::string(vm["network"].as<std::string>());
@@ -272,25 +565,93 @@ int main(int argc, const char *argv[]) {
   // TODO: move DataHandler creation to factory method in DataHandlerGeneric
   DataWriter dataWriter;
 
+  std::vector<std::pair<std::string, DataWriter> > outputs;
   if (conf.hdf5out) {
     XTRACE(MAIN, NOTE, "Creating DataWriter for HDF5");
     std::string extension = conf.split > 0.0f ? runNumber.toString() : "";
-    dataWriter = new DataWriterHDF5(*conf.path, *conf.basename, extension.c_str());
-  } else if (conf.network != nullptr) {
+    DataWriter output;
+    output = new DataWriterHDF5(*conf.path, *conf.basename, extension.c_str(), conf.hdf5);
+    outputs.emplace_back("HDF5", std::move(output));
+  }
+  if (conf.network != nullptr) {
     XTRACE(MAIN, NOTE, "Creating DataWriter for UDP");
-    dataWriter = new DataWriterNetwork(*conf.network, *conf.port, runNumber.value());
-  } else if (conf.nullout) {
+    DataWriter output;
+    output = new DataWriterNetwork(*conf.network, *conf.port, runNumber.value());
+    outputs.emplace_back("Network", std::move(output));
+  }
+  if (conf.nullout) {
     XTRACE(MAIN, WAR, "Creating (dummy) DataWriter for to /dev/null");
-    dataWriter = new DataWriterNull();
-  } else {
+    DataWriter output;
+    output = new DataWriterNull();
+    outputs.emplace_back("Null", std::move(output));
+  }
+  if (outputs.empty()) {
     std::cerr << "No valid data handler." << std::endl;
     return -1;
+  } else if (outputs.size() == 1) {
+    dataWriter = std::move(outputs.front().second);
+  } else {
+    XTRACE(MAIN, NOTE, "Writing to %zu outputs, each from its own thread", outputs.size());
+    size_t depth = conf.writerQueue > 0 ? conf.writerQueue : DataWriterFanout::defaultDepth;
+    DataWriterFanout *fanout = new DataWriterFanout(depth, conf.queuePolicy);
+    for (auto &output : outputs) {
+      fanout->add(output.first, std::move(output.second));
+    }
+    for (size_t i = 0; i < fanout->size(); ++i) {
+      application_control.queues.emplace_back(fanout->name(i), &fanout->stats(i));
+    }
+    XTRACE(MAIN, NOTE, "Outputs share buffers of %zu bytes", fanout->bufferSize());
+    dataWriter = fanout;
+  }
+  /* SWMR readers should see the data within a flush interval, so it is
+   * passed on at least that often instead of waiting for full buffers */
+  unsigned handoff = conf.hdf5out && conf.hdf5.swmr ? conf.hdf5.flushInterval : 0;
+  if (conf.merge) {
+    XTRACE(MAIN, NOTE, "Merging list mode data in time order");
+    DataWriterMerge *merger = new DataWriterMerge(std::move(dataWriter), conf.mergeWindow,
+                                                  conf.coincidence, conf.multiplicity, handoff);
+    application_control.merger = merger;
+    dataWriter = merger;
+  }
+  if (conf.writerQueue > 0 && outputs.size() == 1) {
+    XTRACE(MAIN, NOTE, "Writing data in a separate thread");
+    DataWriterAsync *writer = new DataWriterAsync(std::move(dataWriter), conf.writerQueue,
+                                                  conf.queuePolicy);
+    application_control.queues.emplace_back("Writer", &writer->stats());
+    dataWriter = writer;
   }
   XTRACE(MAIN, INF, "Starting Acquisition");
 
+  /* Prepare digitizers on separate links in parallel */
+  std::vector<std::pair<int, int> > links;
+  for (Digitizer &digitizer : digitizers) {
+    links.emplace_back(digitizer.linkType, digitizer.linkNum);
+  }
+  jadaq::parallel_by_key(links, [&digitizers, &dataWriter, handoff](size_t i) {
+    Digitizer &digitizer = digitizers[i];
+    XTRACE(MAIN, INF, "Prepare acquisition on digitizer %s", digitizer.name().c_str());
+    digitizer.initialize(dataWriter, conf.readoutBuffers, conf.raw, conf.timeSlots, conf.hugePages);
+    if (conf.histogramFile != nullptr) {
+      digitizer.enableHistograms(conf.histogramBins, conf.histogramExtras);
+    }
+    if (handoff > 0) {
+      digitizer.setHandoffInterval(handoff);
+    }
+    digitizer.setPollLimits(conf.pollMin, conf.pollMax);
+    if (conf.interruptAggregates > 0) {
+      if (digitizer.interruptCapable()) {
+        digitizer.enableInterrupt(conf.interruptAggregates);
+      } else {
+        XTRACE(MAIN, WAR, "Interrupts not supported on the link of digitizer %s - polling instead", digitizer.name().c_str());
+      }
+    }
+  });
+  for (Digitizer &digitizer : digitizers) {
+    digitizer.waitReady();
+  }
+  /* Start all digitizers as close together in time as possible */
   for (Digitizer &digitizer : digitizers) {
     XTRACE(MAIN, INF, "Start acquisition on digitizer %s", digitizer.name().c_str());
-    digitizer.initialize(dataWriter);
     digitizer.startAcquisition();
     digitizer.active = true;
   }
@@ -299,11 +660,20 @@ int main(int argc, const char *argv[]) {
   setup_interrupt_handler();
 
   /// setup stop timer and stat timer thread
-  std::thread support(service_thread);
-  support.detach();
-
   application_control.digarr = &digitizers;
+  std::thread support(service_thread);
 
+  std::vector<std::unique_ptr<ReadoutWorker> > workers;
+  if (conf.threaded) {
+    for (Digitizer &digitizer : digitizers) {
+      workers.emplace_back(new ReadoutWorker(digitizer));
+      ReadoutWorker &worker = *workers.back();
+      worker.thread = std::thread(readout_thread, std::ref(worker));
+      if (conf.readoutBuffers > 0) {
+        worker.decoder = std::thread(decoder_thread, std::ref(worker));
+      }
+    }
+  }
 
   XTRACE(MAIN, INF, "Running acquisition loop - Ctrl-C to interrupt");
 
@@ -312,36 +682,53 @@ int main(int argc, const char *argv[]) {
   uint16_t alive = 0;
   Timer acquisitionTimer;
   Timer splitTimer;
-  SteadyTimer readoutTimer;
   while (true) {
     // reset stats
     eventsFound = 0;
     readouts = 0;
     alive = 0;
-    for (Digitizer &digitizer : digitizers) {
-      if (digitizer.active) {
-        try {
-          /* wait a certain amount of time between acquisition attempts to avoid
-           potential hickups on the link */
-          // NOTE: introduced to address issue #18, value determined experimentally
-          // TODO: make this value configurable
-          int gracePeriod = 750 - readoutTimer.elapsedus(); // microseconds
-          if (gracePeriod > 50) {std::this_thread::sleep_for(std::chrono::microseconds(gracePeriod));}
-          else {
-            // wait at least 10us before polling again
-            std::this_thread::sleep_for(std::chrono::microseconds(50));
-          }
-          readoutTimer.reset();
-          digitizer.acquisition();
+    if (conf.threaded) {
+      /* readout happens in the worker threads - only do run control here */
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      for (auto &worker : workers) {
+        if (worker->failed) {
+          worker->digitizer.active = false;
+        }
+      }
+      for (Digitizer &digitizer : digitizers) {
+        if (digitizer.active) {
           alive++;
-        } catch (caen::Error &e) {
-          XTRACE(MAIN, ERR, "ERROR: unexpected exception during acquisition: %s (%d)", e.what(), e.code());
-          digitizer.active = false;
         }
+        eventsFound += digitizer.getStats().eventsFound;
+        readouts += digitizer.getStats().readouts;
+      }
+    } else {
+      /* sleep until the first digitizer is due to be polled */
+      uint32_t wait = std::numeric_limits<uint32_t>::max();
+      for (Digitizer &digitizer : digitizers) {
+        if (digitizer.active) {
+          wait = std::min(wait, digitizer.pollRemaining());
+        }
+      }
+      if (wait > 0 && wait < std::numeric_limits<uint32_t>::max()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait));
+      }
+      for (Digitizer &digitizer : digitizers) {
+        if (digitizer.active) {
+          try {
+            if (digitizer.pollRemaining() == 0) {
+              digitizer.acquisition();
+            }
+            alive++;
+          } catch (caen::Error &e) {
+            XTRACE(MAIN, ERR, "ERROR: unexpected exception during acquisition: %s (%d)", e.what(), e.code());
+            digitizer.active = false;
+          }
+        }
+        // accumulative stats for all digitizers
+        eventsFound += digitizer.getStats().eventsFound;
+        readouts += digitizer.getStats().readouts;
       }
-      // accumulative stats for all digitizers
-      eventsFound += digitizer.getStats().eventsFound;
-      readouts += digitizer.getStats().readouts;
     }
     if (conf.split > 0.0f) {
       if (splitTimer.timeus()/1000000 >= conf.split) {
@@ -368,6 +755,15 @@ int main(int argc, const char *argv[]) {
   }
 
   auto elapsed = acquisitionTimer.timeus();
+  application_control.stop = true;
+  // Before the last histograms are written and the digitizers go away
+  support.join();
+  for (auto &worker : workers) {
+    worker->thread.join();
+    if (worker->decoder.joinable()) {
+      worker->decoder.join();
+    }
+  }
   for (Digitizer &digitizer : digitizers) {
     XTRACE(MAIN, INF, "Stop acquisition on digitizer %s", digitizer.name().c_str());
     try{
@@ -377,6 +773,9 @@ int main(int argc, const char *argv[]) {
     }
   }
   XTRACE(MAIN, ALW, "Acquisition complete - shutting down.");
+  if (conf.histogramFile != nullptr) {
+    writeHistograms(digitizers, *conf.histogramFile);
+  }
   /* Clean up after all digitizers: buffers, etc. */
   for (Digitizer &digitizer : digitizers) {
     try{
@@ -0,0 +1,239 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * K-way merge of roughly time ordered streams into one time ordered stream.
+ * Every stream keeps its pending items sorted, and a tournament tree
+ * over the stream heads emits items once they can no longer be overtaken:
+ * when every stream has moved past them, or when they are more than the
+ * reorder window older than the newest item seen. A stream that falls silent
+ * therefore holds the others back for at most one window. Items older than
+ * the last one emitted cannot be put in order any more. They are set aside
+ * and passed on first with the next drain, in order among themselves.
+ *
+ */
+
+#ifndef JADAQ_MERGE_HPP
+#define JADAQ_MERGE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace jadaq {
+/* T must have a uint64_t time member */
+template <typename T> class time_merge {
+private:
+  /* The sequence number keeps items with the same time in arrival order */
+  struct slot {
+    T item;
+    uint64_t seq;
+  };
+  struct later {
+    bool operator()(const slot &a, const slot &b) const {
+      return a.item.time > b.item.time || (a.item.time == b.item.time && a.seq > b.seq);
+    }
+  };
+  /* Items that arrive in order are appended to a sorted run and consumed from
+   * its head, both O(1). The few that arrive before the end of the run go to
+   * a min-heap, O(log n) for the n items in it. An item with the same time
+   * as the end of the run is appended, so on equal times the run always
+   * holds the earlier arrival. */
+  struct stream {
+    std::vector<T> ordered;
+    size_t head = 0;
+    std::vector<slot> jumbled;
+    uint64_t seq = 0;
+    uint64_t latest = 0; // newest time pushed
+    bool empty() const { return head == ordered.size() && jumbled.empty(); }
+    bool fromJumbled() const {
+      return head == ordered.size() ||
+             (!jumbled.empty() && jumbled.front().item.time < ordered[head].time);
+    }
+    const T &front() const {
+      return fromJumbled() ? jumbled.front().item : ordered[head];
+    }
+    void push(const T &item) {
+      if (head == ordered.size() || item.time >= ordered.back().time) {
+        ordered.push_back(item);
+      } else {
+        jumbled.push_back(slot{item, seq++});
+        std::push_heap(jumbled.begin(), jumbled.end(), later());
+      }
+    }
+    void pop() {
+      if (fromJumbled()) {
+        std::pop_heap(jumbled.begin(), jumbled.end(), later());
+        jumbled.pop_back();
+      } else if (++head == ordered.size()) {
+        ordered.clear();
+        head = 0;
+      } else if (head > 4096 && head > ordered.size() / 2) {
+        // drop consumed items, keeping the allocation
+        ordered.erase(ordered.begin(), ordered.begin() + head);
+        head = 0;
+      }
+    }
+  };
+  std::vector<stream> streams;
+  /* Tournament tree: node n holds the stream with the earliest head among
+   * its two children, leaves start at index leaves and the root is node 1.
+   * Unused leaves hold streams.size(), with the key of an empty stream. */
+  std::vector<size_t> tree;
+  std::vector<uint64_t> key; // head time of every stream and unused leaf
+  size_t leaves = 0;
+  std::vector<T> overdue; // pushed after a later item was emitted
+  uint64_t window_;
+  uint64_t newest = 0;
+  uint64_t last = 0; // time of the last item emitted in order
+  size_t pending_ = 0;
+  uint64_t merged_ = 0;
+  uint64_t late_ = 0;
+
+  /* Whether stream a should be emitted before stream b */
+  bool before(size_t a, size_t b) const {
+    if (key[a] != key[b]) {
+      return key[a] < key[b];
+    }
+    bool emptyA = a >= streams.size() || streams[a].empty();
+    bool emptyB = b >= streams.size() || streams[b].empty();
+    return emptyA == emptyB ? a < b : emptyB;
+  }
+  /* Replay the matches above the leaf of stream index, O(log streams) */
+  void update(size_t index) {
+    const stream &s = streams[index];
+    key[index] = s.empty() ? std::numeric_limits<uint64_t>::max() : s.front().time;
+    for (size_t n = (leaves + index) >> 1; n > 0; n >>= 1) {
+      size_t l = tree[2 * n];
+      size_t r = tree[2 * n + 1];
+      tree[n] = before(r, l) ? r : l;
+    }
+  }
+  void rebuild() {
+    leaves = 1;
+    while (leaves < streams.size()) {
+      leaves <<= 1;
+    }
+    tree.assign(2 * leaves, streams.size());
+    key.resize(streams.size() + 1, std::numeric_limits<uint64_t>::max());
+    for (size_t i = 0; i < streams.size(); ++i) {
+      tree[leaves + i] = i;
+    }
+    for (size_t n = leaves - 1; n > 0; --n) {
+      tree[n] = before(tree[2 * n + 1], tree[2 * n]) ? tree[2 * n + 1] : tree[2 * n];
+    }
+  }
+
+  template <typename F> void emit(F &f, const T &item) {
+    if (item.time < last) {
+      late_ += 1;
+    } else {
+      last = item.time;
+    }
+    merged_ += 1;
+    pending_ -= 1;
+    f(item);
+  }
+
+  /* Emit every item with time <= limit, in time order */
+  template <typename F> size_t emitUpTo(uint64_t limit, F &f) {
+    size_t n = overdue.size();
+    std::stable_sort(overdue.begin(), overdue.end(),
+                     [](const T &a, const T &b) { return a.time < b.time; });
+    for (const T &item : overdue) {
+      emit(f, item);
+    }
+    overdue.clear();
+    for (;;) {
+      size_t i = tree[1];
+      if (i >= streams.size() || streams[i].empty() || streams[i].front().time > limit) {
+        break;
+      }
+      stream &s = streams[i];
+      emit(f, s.front());
+      s.pop();
+      update(i);
+      n += 1;
+    }
+    return n;
+  }
+
+public:
+  /* window: how far, in time units, an item may trail the newest one and
+   * still be put in order */
+  explicit time_merge(uint64_t window) : window_(window) { rebuild(); }
+
+  size_t add_stream() {
+    streams.emplace_back();
+    rebuild();
+    return streams.size() - 1;
+  }
+
+  /* An empty stream holds the others back until the window has passed. Once
+   * closed it no longer does. */
+  void close_stream(size_t index) {
+    streams[index].latest = std::numeric_limits<uint64_t>::max();
+  }
+
+  /* O(1) for items that arrive in order, O(log n) otherwise */
+  void push(size_t index, const T &item) {
+    pending_ += 1;
+    newest = std::max(newest, item.time);
+    stream &s = streams[index];
+    s.latest = std::max(s.latest, item.time);
+    if (item.time < last) {
+      overdue.push_back(item);
+      return;
+    }
+    bool head = s.empty() || item.time < s.front().time;
+    s.push(item);
+    if (head) {
+      update(index);
+    }
+  }
+
+  /* Items older than this can no longer be overtaken */
+  uint64_t watermark() const {
+    uint64_t slowest = std::numeric_limits<uint64_t>::max();
+    for (const stream &s : streams) {
+      slowest = std::min(slowest, s.latest);
+    }
+    uint64_t bound = newest > window_ ? newest - window_ : 0;
+    return streams.empty() ? bound : std::max(bound, slowest);
+  }
+
+  /* Emit what can be emitted in order - returns the number of items */
+  template <typename F> size_t drain(F f) { return emitUpTo(watermark(), f); }
+  /* Emit everything */
+  template <typename F> size_t flush(F f) {
+    return emitUpTo(std::numeric_limits<uint64_t>::max(), f);
+  }
+
+  uint64_t window() const { return window_; }
+  size_t pending() const { return pending_; }
+  uint64_t merged() const { return merged_; }
+  /* Items emitted after a later one, because they trailed by more than the
+   * window or arrived after a flush */
+  uint64_t late() const { return late_; }
+};
+} // namespace jadaq
+#endif // JADAQ_MERGE_HPP
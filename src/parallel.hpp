@@ -0,0 +1,135 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Helpers for running work concurrently: on several digitizers, e.g. one
+ * thread per link while digitizers sharing a link are handled in sequence,
+ * and on a fixed pool of worker threads.
+ *
+ */
+
+#ifndef JADAQ_PARALLEL_HPP
+#define JADAQ_PARALLEL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jadaq {
+/* Call fun(i) for every index i into keys. Indices with equal keys are
+ * handled in order by the same thread, different keys run in parallel.
+ * If any call throws, the first exception is rethrown once all threads
+ * have finished. */
+template <typename K, typename F>
+void parallel_by_key(const std::vector<K> &keys, F fun) {
+  std::map<K, std::vector<size_t> > groups;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    groups[keys[i]].push_back(i);
+  }
+  std::vector<std::exception_ptr> errors(groups.size());
+  std::vector<std::thread> threads;
+  size_t g = 0;
+  for (auto &group : groups) {
+    const std::vector<size_t> &indices = group.second;
+    std::exception_ptr &error = errors[g++];
+    threads.emplace_back([&indices, &error, &fun]() {
+      try {
+        for (size_t i : indices) {
+          fun(i);
+        }
+      } catch (...) {
+        error = std::current_exception();
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+/* Fixed number of threads running the tasks submitted to them, started in
+ * the order they were submitted. Tasks must not throw. Queued tasks are
+ * finished before the pool is destroyed. */
+class task_pool {
+private:
+  std::vector<std::thread> threads;
+  std::deque<std::function<void()> > tasks;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool stop = false;
+
+  void run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this]() { return stop || !tasks.empty(); });
+        if (tasks.empty()) {
+          return;
+        }
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  explicit task_pool(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      threads.emplace_back(&task_pool::run, this);
+    }
+  }
+  task_pool(const task_pool &) = delete;
+  task_pool &operator=(const task_pool &) = delete;
+  ~task_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    ready.notify_all();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+  }
+
+  size_t size() const { return threads.size(); }
+};
+} // namespace jadaq
+#endif // JADAQ_PARALLEL_HPP
@@ -0,0 +1,182 @@
+/**
+ * jadaq (Just Another DAQ)
+ * Copyright (C) 2018  Troels Blum <troels@blum.dk>
+ *
+ * @file
+ * @author Troels Blum <troels@blum.dk>
+ * @section LICENSE
+ * This program is free software: you can redistribute it and/or modify
+ *        it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *         but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ * Lock-free rings used to pass data between threads. spsc_ring connects
+ * exactly two threads e.g. the readout thread and the decoder thread,
+ * mpsc_ring lets any number of threads feed one consumer e.g. a writer
+ * thread.
+ *
+ */
+
+#ifndef JADAQ_RING_HPP
+#define JADAQ_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jadaq {
+template <typename T> class spsc_ring {
+private:
+  static constexpr const size_t cache_line = 64;
+  std::vector<T> slots;
+  size_t const mask;
+  // head and tail live on separate cache lines to avoid false sharing
+  char pad0[cache_line];
+  std::atomic<size_t> head{0}; // next slot to pop - owned by the consumer
+  char pad1[cache_line - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail{0}; // next slot to push - owned by the producer
+  char pad2[cache_line - sizeof(std::atomic<size_t>)];
+
+  static size_t round_up(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+public:
+  /* capacity is rounded up to the nearest power of two */
+  explicit spsc_ring(size_t capacity)
+      : slots(round_up(capacity)), mask(slots.size() - 1) {}
+  spsc_ring(const spsc_ring &) = delete;
+  spsc_ring &operator=(const spsc_ring &) = delete;
+
+  /* Producer side: returns false if the ring is full */
+  bool push(const T &value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size()) {
+      return false;
+    }
+    slots[t & mask] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Consumer side: returns false if the ring is empty */
+  bool pop(T &value) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t capacity() const { return slots.size(); }
+};
+
+/* Bounded multi-producer/single-consumer ring. Every slot carries a sequence
+ * number telling whether it is free for the producer claiming that position
+ * or filled for the consumer, so producers only contend on claiming a
+ * position, never on a lock. */
+template <typename T> class mpsc_ring {
+private:
+  static constexpr const size_t cache_line = 64;
+  struct slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  std::vector<slot> slots;
+  size_t const mask;
+  char pad0[cache_line];
+  std::atomic<size_t> head{0}; // next slot to pop - owned by the consumer
+  char pad1[cache_line - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail{0}; // next slot to claim - shared by the producers
+  char pad2[cache_line - sizeof(std::atomic<size_t>)];
+
+  static size_t round_up(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+public:
+  /* capacity is rounded up to the nearest power of two */
+  explicit mpsc_ring(size_t capacity)
+      : slots(round_up(capacity)), mask(slots.size() - 1) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  mpsc_ring(const mpsc_ring &) = delete;
+  mpsc_ring &operator=(const mpsc_ring &) = delete;
+
+  /* Producer side, any thread: returns false if the ring is full */
+  bool push(const T &value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    slot *s;
+    while (true) {
+      s = &slots[t & mask];
+      intptr_t diff = (intptr_t)s->sequence.load(std::memory_order_acquire) - (intptr_t)t;
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        t = tail.load(std::memory_order_relaxed);
+      }
+    }
+    s->value = value;
+    s->sequence.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Consumer side: returns false if the ring is empty */
+  bool pop(T &value) {
+    size_t h = head.load(std::memory_order_relaxed);
+    slot &s = slots[h & mask];
+    if (s.sequence.load(std::memory_order_acquire) != h + 1) {
+      return false;
+    }
+    value = s.value;
+    s.sequence.store(h + slots.size(), std::memory_order_release);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Claimed slots, including ones still being filled. head is read first,
+   * so the result never wraps below zero. */
+  size_t size() const {
+    size_t h = head.load(std::memory_order_acquire);
+    return tail.load(std::memory_order_acquire) - h;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t capacity() const { return slots.size(); }
+};
+} // namespace jadaq
+#endif // JADAQ_RING_HPP